@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "arena.h"
+#include "stats.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_CHUNKS (ARENA_SIZE / ARENA_CHUNK)
+// bigger blocks are not worth a chunk of their own
+#define ARENA_MAX (ARENA_CHUNK / 4)
+
+typedef struct {
+  char*           base;
+  uint32_t*       live;   // blocks per chunk, +1 for the chunk being bumped
+  uint32_t*       next;   // free list of chunks
+  uint32_t        free, fresh;
+  uint32_t        nfree;  // chunks on the free list
+  pthread_mutex_t lock;
+} Arena;
+
+static Arena arena = { NULL, NULL, NULL, UINT32_MAX, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+static __thread char* bump;
+static __thread char* end;
+static __thread int on;
+
+static const char* const arena_key[] = { "chunks", "pinned", "free" };
+#define ARENA_KEYS (sizeof(arena_key) / sizeof(*arena_key))
+static uint64_t* arena_count;
+
+void* __real_malloc(size_t);
+void* __real_calloc(size_t, size_t);
+void* __real_realloc(void*, size_t);
+void __real_free(void*);
+
+void arena_init(void) {
+  void* base = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(base == MAP_FAILED)
+    return;
+  arena.live = __real_calloc(ARENA_CHUNKS, sizeof(uint32_t));
+  arena.next = __real_malloc(ARENA_CHUNKS * sizeof(uint32_t));
+  if(!arena.live || !arena.next) {
+    munmap(base, ARENA_SIZE);
+    return;
+  }
+  arena.base = base;
+}
+
+static inline int arena_has(const void* ptr) {
+  return arena.base && (uintptr_t)ptr - (uintptr_t)arena.base < ARENA_SIZE;
+}
+
+static void chunk_release(const uint32_t chunk) {
+  if(__atomic_sub_fetch(&arena.live[chunk], 1, __ATOMIC_ACQ_REL))
+    return;
+  pthread_mutex_lock(&arena.lock);
+  arena.next[chunk] = arena.free;
+  arena.free = chunk;
+  arena.nfree++;
+  pthread_mutex_unlock(&arena.lock);
+}
+
+static int chunk_take(void) {
+  uint32_t chunk;
+  pthread_mutex_lock(&arena.lock);
+  if(arena.free != UINT32_MAX) {
+    chunk = arena.free;
+    arena.free = arena.next[chunk];
+    arena.nfree--;
+  } else if(arena.fresh < ARENA_CHUNKS)
+    chunk = arena.fresh++;
+  else {
+    pthread_mutex_unlock(&arena.lock);
+    return 0;
+  }
+  pthread_mutex_unlock(&arena.lock);
+  arena.live[chunk] = 1;
+  bump = arena.base + (size_t)chunk * ARENA_CHUNK;
+  end = bump + ARENA_CHUNK;
+  return 1;
+}
+
+static inline uint32_t chunk_of(const void* ptr) {
+  return ((const char*)ptr - arena.base) / ARENA_CHUNK;
+}
+
+// the size is kept in front of the block for realloc
+static void* arena_alloc(const size_t size) {
+  const size_t need = ARENA_ALIGN + ((size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+  if(need > ARENA_MAX)
+    return NULL;
+  if(!bump || end - bump < (ptrdiff_t)need) {
+    char* const prev = bump;
+    if(!chunk_take())
+      return NULL;
+    if(prev)
+      chunk_release(chunk_of(prev - 1));
+  }
+  char* ptr = bump + ARENA_ALIGN;
+  bump += need;
+  *(size_t*)(ptr - ARENA_ALIGN) = size;
+  __atomic_add_fetch(&arena.live[chunk_of(ptr)], 1, __ATOMIC_RELAXED);
+  if(stats)
+    stats_alloc(alloc_arena);
+  return ptr;
+}
+
+void arena_stats_init(void) {
+  arena_count = stats_group("arena", arena_key, ARENA_KEYS);
+}
+
+// taken as a parse begins, once the last tree is released: the chunks
+// neither free nor bumped by this thread are held by blocks that outlive it
+static void arena_stats(void) {
+  pthread_mutex_lock(&arena.lock);
+  const uint32_t fresh = arena.fresh, nfree = arena.nfree;
+  pthread_mutex_unlock(&arena.lock);
+  stats_max(&arena_count[0], fresh);
+  stats_max(&arena_count[1], fresh - nfree - (bump != NULL));
+  stats_max(&arena_count[2], nfree);
+}
+
+void arena_begin(void) {
+  on = arena.base != NULL;
+  if(on && arena_count)
+    arena_stats();
+}
+
+void arena_end(void) {
+  on = 0;
+}
+
+int arena_pause(void) {
+  const int was = on;
+  on = 0;
+  return was;
+}
+
+void arena_resume(const int was) {
+  on = was;
+}
+
+// --stats and --arena are both behind -Wl,--wrap: this sees the tools
+// and libgwion_ast, not the allocations libc makes for itself
+void* __wrap_malloc(size_t size) {
+  void* ptr;
+  if(stats)
+    stats_alloc(alloc_malloc);
+  if(on && (ptr = arena_alloc(size)))
+    return ptr;
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  void* ptr;
+  if(stats)
+    stats_alloc(alloc_calloc);
+  if(on && size && n <= ARENA_MAX / size && (ptr = arena_alloc(n * size)))
+    return memset(ptr, 0, n * size);
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  if(stats)
+    stats_alloc(alloc_realloc);
+  if(!ptr || !arena_has(ptr))
+    return __real_realloc(ptr, size);
+  const size_t old = *(size_t*)((char*)ptr - ARENA_ALIGN);
+  void* dst = on ? arena_alloc(size) : NULL;
+  if(!dst && !(dst = __real_malloc(size)))
+    return NULL;
+  memcpy(dst, ptr, old < size ? old : size);
+  chunk_release(chunk_of(ptr));
+  return dst;
+}
+
+void __wrap_free(void* ptr) {
+  if(!ptr)
+    return;
+  if(stats)
+    stats_alloc(alloc_free);
+  if(arena_has(ptr))
+    chunk_release(chunk_of(ptr));
+  else
+    __real_free(ptr);
+}
@@ -0,0 +1,21 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#define ARENA_CHUNK (16 << 10)
+#define ARENA_SIZE  (4UL << 30)
+
+// the allocations parse() makes for a tree are bumped out of chunks
+// of one reserved region instead of going to malloc one by one.
+// each chunk counts its live blocks: free() of a block is a decrement,
+// and a chunk is reused as soon as the tree it held is released.
+// a block that outlives its tree would pin its chunk for good.
+void arena_init(void);
+// allocations of the calling thread go to the arena until arena_end
+void arena_begin(void);
+void arena_end(void);
+// around what a parse keeps, the symbols: see __wrap_insert_symbol
+int arena_pause(void);
+void arena_resume(const int);
+// --stats: the most chunks used, pinned and free when a parse began
+void arena_stats_init(void);
+#endif
@@ -0,0 +1,282 @@
+#include "defs.h"
+#include "map.h"
+#include "absyn.h"
+#include "hash.h"
+#include "astview.h"
+#include "stats.h"
+#include "scan.h"
+
+static void release_section(Section* section) {
+  if(section->section_type == ae_section_func)
+    section->d.func_def->flag &= ~ae_flag_template;
+  else if(section->section_type == ae_section_class) {
+    Class_Body body = section->d.class_def->body;
+    while(body) {
+      release_section(body->section);
+      body = body->next;
+    }
+  }
+}
+
+void release_ast(Ast ast) {
+  for(Ast a = ast; a; a = a->next)
+    release_section(a->section);
+  free_ast(ast);
+}
+
+static const char* const exp_kind[] = {
+  [ae_exp_decl] = "decl",
+  [ae_exp_binary] = "binary",
+  [ae_exp_unary] = "unary",
+  [ae_exp_primary] = "primary",
+  [ae_exp_cast] = "cast",
+  [ae_exp_post] = "post",
+  [ae_exp_call] = "call",
+  [ae_exp_array] = "array",
+  [ae_exp_if] = "if",
+  [ae_exp_dot] = "dot",
+  [ae_exp_dur] = "dur",
+};
+#define EXP_KINDS (sizeof(exp_kind) / sizeof(*exp_kind))
+
+static const char* const stmt_kind[] = {
+  [ae_stmt_exp] = "exp",
+  [ae_stmt_while] = "while",
+  [ae_stmt_until] = "until",
+  [ae_stmt_for] = "for",
+  [ae_stmt_auto] = "auto",
+  [ae_stmt_loop] = "loop",
+  [ae_stmt_if] = "if",
+  [ae_stmt_code] = "code",
+  [ae_stmt_switch] = "switch",
+  [ae_stmt_break] = "break",
+  [ae_stmt_continue] = "continue",
+  [ae_stmt_return] = "return",
+  [ae_stmt_case] = "case",
+  [ae_stmt_jump] = "jump",
+  [ae_stmt_enum] = "enum",
+  [ae_stmt_fptr] = "fptr",
+  [ae_stmt_type] = "type",
+  [ae_stmt_union] = "union",
+  [ae_stmt_pp] = "pp",
+};
+#define STMT_KINDS (sizeof(stmt_kind) / sizeof(*stmt_kind))
+
+static const char* const section_kind[] = {
+  [ae_section_stmt] = "stmt",
+  [ae_section_func] = "func",
+  [ae_section_class] = "class",
+};
+#define SECTION_KINDS (sizeof(section_kind) / sizeof(*section_kind))
+
+// one slot per kind, counted into locally then added to the shared block
+typedef struct {
+  uint64_t exp[EXP_KINDS];
+  uint64_t stmt[STMT_KINDS];
+  uint64_t section[SECTION_KINDS];
+} Count;
+
+static uint64_t *exp_count, *stmt_count, *section_count;
+
+static void count_stmt(Count* count, CStmt stmt);
+static void count_section(Count* count, const Section* section);
+
+static void count_id_list(CID_List list) {
+  for(; list; list = list->next)
+    scan_symbol(list->xid);
+}
+
+static void count_td(const Type_Decl* td) {
+  if(td)
+    count_id_list(td->xid);
+}
+
+static void count_args(Arg_List list) {
+  for(; list; list = list->next) {
+    count_td(list->td);
+    scan_symbol(list->var_decl->xid);
+  }
+}
+
+static void count_exp(Count* count, CExp exp) {
+  for(; exp; exp = exp->next) {
+    if((size_t)exp->exp_type < EXP_KINDS)
+      count->exp[exp->exp_type]++;
+    switch(exp->exp_type) {
+      case ae_exp_primary: {
+        const Exp_Primary* p = &exp->d.exp_primary;
+        if(p->primary_type == ae_primary_id)
+          scan_symbol(p->d.var);
+        else if(p->primary_type == ae_primary_array)
+          count_exp(count, p->d.array->exp);
+        else if(p->primary_type == ae_primary_hack)
+          count_exp(count, p->d.exp);
+        else if(p->primary_type == ae_primary_complex ||
+            p->primary_type == ae_primary_polar ||
+            p->primary_type == ae_primary_vec)
+          count_exp(count, p->d.vec.exp);
+        break;
+      }
+      case ae_exp_decl:
+        count_td(exp->d.exp_decl.td);
+        for(Var_Decl_List l = exp->d.exp_decl.list; l; l = l->next) {
+          scan_symbol(l->self->xid);
+          if(l->self->array)
+            count_exp(count, l->self->array->exp);
+        }
+        break;
+      case ae_exp_unary:
+        if(exp->d.exp_unary.code)
+          count_stmt(count, exp->d.exp_unary.code);
+        else
+          count_exp(count, exp->d.exp_unary.exp);
+        break;
+      case ae_exp_binary:
+        count_exp(count, exp->d.exp_binary.lhs);
+        count_exp(count, exp->d.exp_binary.rhs);
+        break;
+      case ae_exp_post:
+        count_exp(count, exp->d.exp_post.exp);
+        break;
+      case ae_exp_cast:
+        count_exp(count, exp->d.exp_cast.exp);
+        break;
+      case ae_exp_call:
+        count_exp(count, exp->d.exp_call.func);
+        count_exp(count, exp->d.exp_call.args);
+        break;
+      case ae_exp_array:
+        count_exp(count, exp->d.exp_array.base);
+        count_exp(count, exp->d.exp_array.array->exp);
+        break;
+      case ae_exp_dot:
+        count_exp(count, exp->d.exp_dot.base);
+        scan_symbol(exp->d.exp_dot.xid);
+        break;
+      case ae_exp_dur:
+        count_exp(count, exp->d.exp_dur.base);
+        count_exp(count, exp->d.exp_dur.unit);
+        break;
+      case ae_exp_if:
+        count_exp(count, exp->d.exp_if.cond);
+        count_exp(count, exp->d.exp_if.if_exp);
+        count_exp(count, exp->d.exp_if.else_exp);
+        break;
+    }
+  }
+}
+
+static void count_stmt_list(Count* count, CStmt_List list) {
+  for(; list; list = list->next)
+    count_stmt(count, list->stmt);
+}
+
+static void count_stmt(Count* count, CStmt stmt) {
+  if(!stmt)
+    return;
+  if((size_t)stmt->stmt_type < STMT_KINDS)
+    count->stmt[stmt->stmt_type]++;
+  switch(stmt->stmt_type) {
+    case ae_stmt_exp:
+    case ae_stmt_return:
+    case ae_stmt_case:
+      count_exp(count, stmt->d.stmt_exp.val);
+      break;
+    case ae_stmt_code:
+      count_stmt_list(count, stmt->d.stmt_code.stmt_list);
+      break;
+    case ae_stmt_if:
+      count_exp(count, stmt->d.stmt_if.cond);
+      count_stmt(count, stmt->d.stmt_if.if_body);
+      count_stmt(count, stmt->d.stmt_if.else_body);
+      break;
+    case ae_stmt_while:
+    case ae_stmt_until:
+      count_exp(count, stmt->d.stmt_flow.cond);
+      count_stmt(count, stmt->d.stmt_flow.body);
+      break;
+    case ae_stmt_for:
+      count_stmt(count, stmt->d.stmt_for.c1);
+      count_stmt(count, stmt->d.stmt_for.c2);
+      count_exp(count, stmt->d.stmt_for.c3);
+      count_stmt(count, stmt->d.stmt_for.body);
+      break;
+    case ae_stmt_auto:
+      scan_symbol(stmt->d.stmt_auto.sym);
+      count_exp(count, stmt->d.stmt_auto.exp);
+      count_stmt(count, stmt->d.stmt_auto.body);
+      break;
+    case ae_stmt_loop:
+      count_exp(count, stmt->d.stmt_loop.cond);
+      count_stmt(count, stmt->d.stmt_loop.body);
+      break;
+    case ae_stmt_switch:
+      count_exp(count, stmt->d.stmt_switch.val);
+      count_stmt(count, stmt->d.stmt_switch.stmt);
+      break;
+    case ae_stmt_union:
+      scan_symbol(stmt->d.stmt_union.xid);
+      scan_symbol(stmt->d.stmt_union.type_xid);
+      for(Decl_List l = stmt->d.stmt_union.l; l; l = l->next)
+        count_exp(count, l->self);
+      break;
+    case ae_stmt_enum:
+      scan_symbol(stmt->d.stmt_enum.xid);
+      count_id_list(stmt->d.stmt_enum.list);
+      break;
+    case ae_stmt_fptr:
+      scan_symbol(stmt->d.stmt_fptr.xid);
+      count_td(stmt->d.stmt_fptr.td);
+      count_args(stmt->d.stmt_fptr.args);
+      break;
+    case ae_stmt_type:
+      scan_symbol(stmt->d.stmt_type.xid);
+      count_td(stmt->d.stmt_type.td);
+      break;
+    case ae_stmt_jump:
+      scan_symbol(stmt->d.stmt_jump.name);
+      break;
+    default:
+      break;
+  }
+}
+
+static void count_section(Count* count, const Section* section) {
+  if((size_t)section->section_type < SECTION_KINDS)
+    count->section[section->section_type]++;
+  if(section->section_type == ae_section_stmt)
+    count_stmt_list(count, section->d.stmt_list);
+  else if(section->section_type == ae_section_func) {
+    CFunc_Def f = section->d.func_def;
+    scan_symbol(f->name);
+    count_td(f->td);
+    count_args(f->arg_list);
+    count_stmt(count, f->d.code);
+  } else if(section->section_type == ae_section_class) {
+    count_id_list(section->d.class_def->name);
+    count_td(section->d.class_def->ext);
+    for(Class_Body body = section->d.class_def->body; body; body = body->next)
+      count_section(count, body->section);
+  }
+}
+
+void ast_stats_init(void) {
+  exp_count = stats_group("exp", exp_kind, EXP_KINDS);
+  stmt_count = stats_group("stmt", stmt_kind, STMT_KINDS);
+  section_count = stats_group("section", section_kind, SECTION_KINDS);
+}
+
+void ast_stats(CAst ast) {
+  Count count = { { 0 }, { 0 }, { 0 } };
+  if(!stats || !exp_count)
+    return;
+  for(; ast; ast = ast->next)
+    count_section(&count, ast->section);
+  for(size_t i = 0; i < EXP_KINDS; i++)
+    stats_count(&exp_count[i], count.exp[i]);
+  for(size_t i = 0; i < STMT_KINDS; i++)
+    stats_count(&stmt_count[i], count.stmt[i]);
+  for(size_t i = 0; i < SECTION_KINDS; i++)
+    stats_count(&section_count[i], count.section[i]);
+  scan_stats();
+}
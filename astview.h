@@ -0,0 +1,41 @@
+#ifndef ASTVIEW_H
+#define ASTVIEW_H
+
+// read-only handles on a parsed tree. the walkers take these,
+// so one tree can be walked by several of them, on several threads.
+// const stops at the node a walker is handed: a walker never writes
+// through the children it loads either, it hands them on.
+typedef const struct Ast_*         CAst;
+typedef const struct Exp_*         CExp;
+typedef const struct Stmt_*        CStmt;
+typedef const struct Stmt_List_*   CStmt_List;
+typedef const struct Stmt_Exp_*    CStmt_Exp;
+typedef const struct Stmt_Code_*   CStmt_Code;
+typedef const struct Stmt_Flow_*   CStmt_Flow;
+typedef const struct Stmt_For_*    CStmt_For;
+typedef const struct Stmt_Auto_*   CStmt_Auto;
+typedef const struct Stmt_Loop_*   CStmt_Loop;
+typedef const struct Stmt_Switch_* CStmt_Switch;
+typedef const struct Stmt_If_*     CStmt_If;
+typedef const struct Stmt_Enum_*   CStmt_Enum;
+typedef const struct Stmt_Fptr_*   CStmt_Fptr;
+typedef const struct Stmt_Type_*   CStmt_Type;
+typedef const struct Stmt_Union_*  CStmt_Union;
+typedef const struct Stmt_Jump_*   CStmt_Jump;
+typedef const struct Stmt_PP_*     CStmt_PP;
+typedef const struct Func_Def_*    CFunc_Def;
+typedef const struct Class_Def_*   CClass_Def;
+typedef const struct Array_Sub_*   CArray_Sub;
+typedef const struct Type_List_*   CType_List;
+typedef const struct ID_List_*     CID_List;
+
+// the one write left: template functions are flagged for the type checker,
+// which the tools do not run, so they are unflagged for free_ast to take
+// them back. call it once every walker is done with the tree.
+void release_ast(Ast);
+
+// count the nodes of a tree by kind into the --stats report.
+// register the counters with ast_stats_init before forking workers.
+void ast_stats_init(void);
+void ast_stats(CAst);
+#endif
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "defs.h"
+#include "cache.h"
+
+// builds outside the Makefile are told apart by when they were made
+#ifndef CACHE_BUILD
+#define CACHE_BUILD __DATE__ " " __TIME__
+#endif
+
+typedef struct {
+  char   name[17];
+  time_t mtime;
+  off_t  size;
+} Slot;
+
+static uint64_t fnv(uint64_t h, const char* str, const size_t len) {
+  for(size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)str[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+uint64_t cache_key(const char* tool, const m_str name, const char* src,
+    const size_t len) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  h = fnv(h, CACHE_BUILD, sizeof(CACHE_BUILD));
+  h = fnv(h, tool, strlen(tool) + 1);
+  h = fnv(h, name, strlen(name) + 1);
+  return fnv(h, src, len);
+}
+
+m_bool cache_open(Cache* cache, const m_str dir, const size_t max) {
+  if(mkdir(dir, 0777) && access(dir, W_OK)) {
+    perror(dir);
+    return 0;
+  }
+  cache->stats = mmap(NULL, sizeof(CacheStats), PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(cache->stats == MAP_FAILED)
+    return 0;
+  memset(cache->stats, 0, sizeof(CacheStats));
+  cache->dir = dir;
+  cache->max = max;
+  return 1;
+}
+
+static void cache_count(m_uint* n) {
+  __atomic_fetch_add(n, 1, __ATOMIC_RELAXED);
+}
+
+m_bool cache_get(Cache* cache, const uint64_t key, CacheEntry* entry) {
+  char path[strlen(cache->dir) + 18];
+  struct stat st;
+  sprintf(path, "%s/%016lx", cache->dir, (unsigned long)key);
+  const int fd = open(path, O_RDONLY);
+  if(fd == -1 || fstat(fd, &st) || (size_t)st.st_size < sizeof(CacheHeader)) {
+    if(fd != -1)
+      close(fd);
+    cache_count(&cache->stats->miss);
+    return 0;
+  }
+  entry->size = st.st_size;
+  entry->map = mmap(NULL, entry->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(entry->map != MAP_FAILED)
+    futimens(fd, NULL);
+  close(fd);
+  if(entry->map == MAP_FAILED) {
+    cache_count(&cache->stats->miss);
+    return 0;
+  }
+  const CacheHeader* head = (const CacheHeader*)entry->map;
+  size_t off = sizeof(CacheHeader);
+  m_bool ok = !memcmp(head->magic, CACHE_MAGIC, 4) &&
+    head->version == CACHE_VERSION && head->key == key;
+  for(m_uint i = 0; ok && i < CACHE_SECTIONS; i++) {
+    entry->sec[i] = (const char*)entry->map + off;
+    entry->len[i] = head->len[i];
+    off += head->len[i];
+    ok = off <= entry->size;
+  }
+  if(!ok) {
+    cache_done(entry);
+    cache_count(&cache->stats->miss);
+    return 0;
+  }
+  cache_count(&cache->stats->hit);
+  return 1;
+}
+
+void cache_done(CacheEntry* entry) {
+  munmap(entry->map, entry->size);
+}
+
+// written aside then renamed, so a reader never sees half an entry
+void cache_put(Cache* cache, const uint64_t key, const char** sec,
+    const size_t* len) {
+  char path[strlen(cache->dir) + 18], tmp[strlen(cache->dir) + 40];
+  CacheHeader head = { CACHE_MAGIC, CACHE_VERSION, key, { 0 } };
+  FILE* file;
+  sprintf(path, "%s/%016lx", cache->dir, (unsigned long)key);
+  sprintf(tmp, "%s.%ld", path, (long)getpid());
+  if(!(file = fopen(tmp, "w")))
+    return;
+  for(m_uint i = 0; i < CACHE_SECTIONS; i++)
+    head.len[i] = sec[i] ? len[i] : 0;
+  m_bool ok = fwrite(&head, sizeof(head), 1, file) == 1;
+  for(m_uint i = 0; ok && i < CACHE_SECTIONS; i++)
+    ok = !head.len[i] || fwrite(sec[i], head.len[i], 1, file) == 1;
+  if(fclose(file) || !ok || rename(tmp, path)) {
+    unlink(tmp);
+    return;
+  }
+  cache_count(&cache->stats->store);
+}
+
+static int slot_cmp(const void* a, const void* b) {
+  const time_t x = ((const Slot*)a)->mtime, y = ((const Slot*)b)->mtime;
+  return (x > y) - (x < y);
+}
+
+static void cache_trim(Cache* cache) {
+  DIR* dir = opendir(cache->dir);
+  struct dirent* ent;
+  Slot* slot = NULL;
+  m_uint n = 0, cap = 0;
+  size_t total = 0;
+  if(!dir)
+    return;
+  while((ent = readdir(dir))) {
+    struct stat st;
+    if(strlen(ent->d_name) != 16 ||
+        strspn(ent->d_name, "0123456789abcdef") != 16)
+      continue;
+    char path[strlen(cache->dir) + 18];
+    sprintf(path, "%s/%s", cache->dir, ent->d_name);
+    if(stat(path, &st))
+      continue;
+    if(n == cap) {
+      cap = cap ? cap * 2 : 256;
+      slot = realloc(slot, cap * sizeof(Slot));
+    }
+    strcpy(slot[n].name, ent->d_name);
+    slot[n].mtime = st.st_mtime;
+    slot[n].size = st.st_size;
+    total += slot[n++].size;
+  }
+  closedir(dir);
+  qsort(slot, n, sizeof(Slot), slot_cmp);
+  for(m_uint i = 0; i < n && total > cache->max; i++) {
+    char path[strlen(cache->dir) + 18];
+    sprintf(path, "%s/%s", cache->dir, slot[i].name);
+    if(unlink(path))
+      continue;
+    total -= slot[i].size;
+    cache->stats->evict++;
+  }
+  free(slot);
+}
+
+void cache_close(Cache* cache, const m_bool stats) {
+  const CacheStats* s = cache->stats;
+  if(s->store)
+    cache_trim(cache);
+  if(stats) {
+    const m_uint n = s->hit + s->miss;
+    fprintf(stderr, "%s: %lu hits, %lu misses (%.1f%% hit rate), "
+        "%lu stored, %lu evicted\n", cache->dir, s->hit, s->miss,
+        n ? 100. * s->hit / n : 0., s->store, s->evict);
+  }
+  munmap(cache->stats, sizeof(CacheStats));
+}
@@ -0,0 +1,45 @@
+#ifndef CACHE_H
+#define CACHE_H
+#include <stdint.h>
+
+#define CACHE_MAGIC "GWCA"
+#define CACHE_VERSION 4
+#define CACHE_SECTIONS 3
+#define CACHE_SIZE (256 << 20)
+
+// one entry per file, named after its key, holding what the tool
+// made of the file: the key covers the build, the tool, its options, the
+// file name and content, so an entry never needs invalidating, only evicting.
+typedef struct {
+  char     magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint64_t len[CACHE_SECTIONS];
+} CacheHeader;
+
+// shared with forked workers
+typedef struct {
+  m_uint hit, miss, store, evict;
+} CacheStats;
+
+typedef struct {
+  m_str       dir;
+  size_t      max;
+  CacheStats* stats;
+} Cache;
+
+typedef struct {
+  void*       map;
+  size_t      size;
+  const char* sec[CACHE_SECTIONS];
+  size_t      len[CACHE_SECTIONS];
+} CacheEntry;
+
+m_bool cache_open(Cache*, const m_str, const size_t);
+uint64_t cache_key(const char*, const m_str, const char*, const size_t);
+m_bool cache_get(Cache*, const uint64_t, CacheEntry*);
+void cache_done(CacheEntry*);
+void cache_put(Cache*, const uint64_t, const char**, const size_t*);
+// trims the least recently used entries down to the bound
+void cache_close(Cache*, const m_bool);
+#endif
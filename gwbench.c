@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define BENCH_ARGS 8
+
+// each tool is run over the whole corpus in one process, as a build would
+typedef struct {
+  const char* name;
+  const char* argv[BENCH_ARGS];
+} Bench;
+
+static const Bench bench[] = {
+  { "gwpp",          { "./gwpp", NULL } },
+  { "gwpp -l",       { "./gwpp", "-l", NULL } },
+  { "gwpp --arena",  { "./gwpp", "--arena", NULL } },
+  { "gwtag",         { "./gwtag", "-o", "@tags", NULL } },
+  { "gwtag -x -d",   { "./gwtag", "-o", "@tags", "-x", "@refs", "-d", "@deps", NULL } },
+  { "gwtag --arena", { "./gwtag", "--arena", "-o", "@tags", NULL } },
+  { "gwtools",       { "./gwtools", "-o", "@tags", NULL } },
+};
+#define BENCHES (sizeof(bench) / sizeof(*bench))
+
+typedef struct {
+  double seconds;
+  double files;
+  double mb;
+} Result;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// "@name" arguments are outputs, put in the scratch directory
+static double bench_run(const Bench* b, const char* tmp, char** file,
+    const int nfile) {
+  const char* argv[BENCH_ARGS + nfile];
+  char out[BENCH_ARGS][strlen(tmp) + 16];
+  int argc = 0, status;
+  for(; b->argv[argc]; argc++) {
+    if(*b->argv[argc] == '@') {
+      sprintf(out[argc], "%s/%s", tmp, b->argv[argc] + 1);
+      argv[argc] = out[argc];
+    } else
+      argv[argc] = b->argv[argc];
+  }
+  for(int i = 0; i < nfile; i++)
+    argv[argc++] = file[i];
+  argv[argc] = NULL;
+  const double start = now();
+  const pid_t pid = fork();
+  if(!pid) {
+    const int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    execv(argv[0], (char**)argv);
+    _exit(127);
+  }
+  if(pid == -1 || waitpid(pid, &status, 0) != pid ||
+      !WIFEXITED(status) || WEXITSTATUS(status) == 127)
+    return -1;
+  return now() - start;
+}
+
+// the baseline is a file this program wrote: one benchmark per line
+static int baseline_find(FILE* file, const char* name, Result* r) {
+  char line[256], key[64];
+  rewind(file);
+  while(fgets(line, sizeof(line), file))
+    if(sscanf(line, " {\"name\":\"%63[^\"]\",\"seconds\":%lf,\"files_per_s\":%lf,"
+        "\"mb_per_s\":%lf}", key, &r->seconds, &r->files, &r->mb) == 4 &&
+        !strcmp(key, name))
+      return 1;
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  const char* out = NULL, *base = NULL;
+  unsigned long repeat = 3;
+  double tolerance = 10;
+  off_t bytes = 0;
+  int ret = 0, written = 0;
+  char tmp[] = "/tmp/gwbench.XXXXXX";
+  argc--; argv++;
+  while(argc && **argv == '-') {
+    if(!strcmp(*argv, "-o") && argc > 1)
+      out = argv[1];
+    else if(!strcmp(*argv, "-b") && argc > 1)
+      base = argv[1];
+    else if(!strcmp(*argv, "-r") && argc > 1)
+      repeat = strtoul(argv[1], NULL, 10);
+    else if(!strcmp(*argv, "-t") && argc > 1)
+      tolerance = strtod(argv[1], NULL);
+    else {
+      fprintf(stderr, "usage: gwbench [-o result] [-b baseline] [-r repeat] "
+          "[-t percent] file...\n");
+      return 2;
+    }
+    argc -= 2;
+    argv += 2;
+  }
+  if(!argc || !repeat)
+    return 2;
+  for(int i = 0; i < argc; i++) {
+    struct stat st;
+    if(!stat(argv[i], &st))
+      bytes += st.st_size;
+  }
+  if(!mkdtemp(tmp)) {
+    perror(tmp);
+    return 2;
+  }
+  FILE* baseline = base ? fopen(base, "r") : NULL;
+  FILE* file = out ? fopen(out, "w") : stdout;
+  if(!file) {
+    perror(out);
+    return 2;
+  }
+  fprintf(file, "{\"files\":%d,\"bytes\":%lld,\"results\":[\n", argc, (long long)bytes);
+  for(size_t i = 0; i < BENCHES; i++) {
+    Result r = { -1, 0, 0 }, b;
+    // the best of the runs: the others measure the machine
+    for(unsigned long j = 0; j < repeat; j++) {
+      const double t = bench_run(&bench[i], tmp, argv, argc);
+      if(t >= 0 && (r.seconds < 0 || t < r.seconds))
+        r.seconds = t;
+    }
+    if(r.seconds <= 0) {
+      fprintf(stderr, "%s: did not run\n", bench[i].name);
+      ret = 2;
+      continue;
+    }
+    r.files = argc / r.seconds;
+    r.mb = bytes / r.seconds / (1 << 20);
+    // the comma goes before an entry: the last bench may not have run
+    fprintf(file, "%s  {\"name\":\"%s\",\"seconds\":%.6f,\"files_per_s\":%.1f,"
+        "\"mb_per_s\":%.3f}", written++ ? ",\n" : "", bench[i].name, r.seconds,
+        r.files, r.mb);
+    fprintf(stderr, "%-14s %9.1f files/s %9.3f MB/s", bench[i].name, r.files, r.mb);
+    if(baseline && baseline_find(baseline, bench[i].name, &b)) {
+      const double change = (r.mb / b.mb - 1) * 100;
+      fprintf(stderr, " %+6.1f%%", change);
+      if(change < -tolerance) {
+        fprintf(stderr, " regression");
+        if(!ret)
+          ret = 1;
+      }
+    }
+    fprintf(stderr, "\n");
+  }
+  fprintf(file, "%s]}\n", written ? "\n" : "");
+  if(out)
+    fclose(file);
+  if(baseline)
+    fclose(baseline);
+  for(size_t i = 0; i < BENCHES; i++)
+    for(int j = 0; bench[i].argv[j]; j++)
+      if(*bench[i].argv[j] == '@') {
+        char name[sizeof(tmp) + 16];
+        sprintf(name, "%s/%s", tmp, bench[i].argv[j] + 1);
+        unlink(name);
+      }
+  char manifest[sizeof(tmp) + 16];
+  sprintf(manifest, "%s/tags.manifest", tmp);
+  unlink(manifest);
+  rmdir(tmp);
+  return ret;
+}
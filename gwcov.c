@@ -3,12 +3,22 @@
 #include <errno.h>
 #include <string.h>
 #include <math.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
 #include <stdio.h>
 #include <unistd.h>
+#include "stats.h"
+#include "prefetch.h"
 
 #define TABLEN 2
 #define MIN_LINE 64
+#define CHUNK_LINES 16384
+#define CHUNK_AHEAD 4  // chunks per worker rendered ahead of the writer
 typedef struct {
   uint set;
   uint ini;
@@ -16,12 +26,21 @@ typedef struct {
 
 typedef struct {
   uint line_count;
-  char* line;
+  const char* line; // a slice of the source, without its newline
   uint i;
   char c[8];
-  ssize_t s;
+  size_t s;
 } Data;
 
+// the source is mapped, and where each of its lines starts is found in
+// one pass of memchr, so any line can be had without reading the others
+typedef struct {
+  const char* src;
+  size_t size;
+  size_t* off;  // one more than there are lines: the last is the end
+  uint n;
+} Source;
+
 typedef struct {
   const char* base;
   FILE* out;
@@ -29,6 +48,10 @@ typedef struct {
   uint max_exec;
   Line* lines;
   char* postfix;
+  int tty;  // out is a terminal, and the widths below are set
+  int max_line_digit;
+  int max_exec_digit;
+  uint line_size;
 } Cov;
 
 typedef void (*cov_func)(Cov*,Data*);
@@ -45,9 +68,12 @@ static void err(const char* base, const char* file) {
 
 static void da(Cov* cov, Data* d) {
   if(d->i >= d->line_count) {
-    cov->lines = realloc(cov->lines, 2 * d->line_count * sizeof(Line));
-    memset(cov->lines + d->line_count, 0, d->line_count * sizeof(Line));
-    d->line_count *= 2;
+    uint count = d->line_count;
+    while(count <= d->i)
+      count *= 2;
+    cov->lines = realloc(cov->lines, count * sizeof(Line));
+    memset(cov->lines + d->line_count, 0, (count - d->line_count) * sizeof(Line));
+    d->line_count = count;
   }
   cov->lines[d->i].set++;
   if(d->i > cov->last)
@@ -55,23 +81,35 @@ static void da(Cov* cov, Data* d) {
 }
 
 static void co(Cov *cov, Data* d) {
-  if(!strcmp(d->c, "ini")) {
+  if(d->i <= cov->last && !strcmp(d->c, "ini")) {
     cov->lines[d->i].ini++;
     cov->max_exec++;
   }
 }
 
-static void run(Cov *cov, void(*func)(Cov*, Data*)) {
+// a coverage file could not be read: say which, and give up
+static void missing(const Cov* cov) {
+  char filename[strlen(cov->base) + strlen(cov->postfix) + 1];
+  sprintf(filename, "%s%s", cov->base, cov->postfix);
+  err(cov->base, filename);
+}
+
+static int run(Cov *cov, void(*func)(Cov*, Data*)) {
   char filename[strlen(cov->base) + strlen(cov->postfix)+ 1];
   Data d;
   FILE* f;
+  StatClock clock;
 
   memset(&d, 0, sizeof(Data));
   d.line_count = MIN_LINE;
 
   sprintf(filename, "%s%s", cov->base, cov->postfix);
-  if(!(f = fopen(filename, "r")))
-    err(cov->base, filename);
+  stats_start(&clock);
+  f = fopen(filename, "r");
+  stats_stop(&clock, phase_open);
+  if(!f)
+    return 0;
+  stats_start(&clock);
   while (1) {
     int ret = fscanf(f, "%u %8s", &d.i, 
 (char*)&d.c);
@@ -87,6 +125,8 @@ static void run(Cov *cov, void(*func)(Cov*, Data*)) {
     }
   }
   fclose(f);
+  stats_stop(&clock, phase_parse);
+  return 1;
 }
 
 static void colorize(char* out, size_t* i, const char* color ) {
@@ -98,22 +138,29 @@ static void colorize(char* out, size_t* i, const char* color ) {
   out[(*i)++] = 'm';
 }
 
-static void detab(char* in, char* out, size_t max_len, uint* has_comment) {
+// out has room for TABLEN bytes for each of in, and for the colors
+static size_t detab(const char* in, const size_t len, char* out, uint* has_comment) {
   size_t i = 0;
-  while(*in && i < max_len - 1) {
-    if(*in == '\t') {
-      for(int j = 0; j < TABLEN; j++)
+  for(size_t j = 0; j < len; j++) {
+    if(in[j] == '\t') {
+      for(int k = 0; k < TABLEN; k++)
         out[i++] = ' ';
-    } else if(!*has_comment && (*in) == '/' && *(in + 1) && *(in + 1) == '/') {
+    } else if(!*has_comment && in[j] == '/' && j + 1 < len && in[j + 1] == '/') {
       *has_comment = 1;
       colorize(out, &i, "0");
       colorize(out, &i, "2");
-      out[i++] = *in;
+      out[i++] = in[j];
     } else
-      out[i++] = *in;
-      (*in)++;
+      out[i++] = in[j];
   }
   out[i] = 0;
+  return i;
+}
+
+// lines past the last one the coverage knows of were not run
+static const Line* cov_line(const Cov* cov, const uint i) {
+  static const Line none;
+  return i <= cov->last ? &cov->lines[i] : &none;
 }
 
 static void fill(Cov* cov, uint min, uint max) {
@@ -121,84 +168,491 @@ static void fill(Cov* cov, uint min, uint max) {
     fprintf(cov->out, " ");
 }
 
-static void tty(Cov* cov, Data* d) {
-  int max_line_digit = floor(log10(cov->last) + 1);
-  int max_exec_digit = floor(log10(cov->max_exec) + 1);
+// the widths are the same for every line of a file: work them out once
+static void layout(Cov* cov) {
   struct winsize w;
-
+  cov->max_line_digit = floor(log10(cov->last) + 1);
+  cov->max_exec_digit = floor(log10(cov->max_exec) + 1);
   ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-  uint line_size = w.ws_col - max_line_digit - max_exec_digit - 6;
+  cov->line_size = w.ws_col - cov->max_line_digit - cov->max_exec_digit - 6;
+}
+
+static void tty(Cov* cov, Data* d) {
+  const uint line_size = cov->line_size;
   uint too_long = 0;
   uint has_comment = 0;
   uint num_digit = d->line_count ? floor(log10(d->line_count) + 1) : 1;
-  ssize_t line_len = ((uint)d->s > line_size) ? (ssize_t)line_size  - 1: d->s - 1;
-  if((uint)d->s > line_size)
+  size_t line_len = d->s >= line_size ? line_size - 1 : d->s;
+  if(d->s >= line_size)
     too_long = 1;
+  const Line* line = cov_line(cov, d->line_count);
   const char* prefix;
-  char detabed[TABLEN*line_len];
-  char *stripped_line = d->s == 1 ? strdup("") : strndup(d->line, line_len);
-  detab(stripped_line, detabed, TABLEN*line_len, &has_comment);
-  free(stripped_line);
-  line_len = strlen(detabed);
-  if(cov->lines[d->line_count].set) {
-    prefix = cov->lines[d->line_count].ini ?
+  char detabed[TABLEN * line_len + 16];
+  line_len = detab(d->line, line_len, detabed, &has_comment);
+  if(line->set) {
+    prefix = line->ini ?
     "\033[32m" : "\033[31m";
   } else
     prefix = "";
   fprintf(cov->out, "\033[2m%i", d->line_count);
-  fill(cov, num_digit, max_line_digit);
+  fill(cov, num_digit, cov->max_line_digit);
   fprintf(cov->out, ":\033[0m %s%s\033[0m\033[2m", prefix, detabed);
   fill(cov, line_len, line_size + (has_comment ? 8 : 0));
-  if(cov->lines[d->line_count].set)
+  if(line->set)
     fprintf(cov->out, "%s (%i)\n\033[0m",
-        too_long ? "\b\b..." : "|", cov->lines[d->line_count].ini);
+        too_long ? "\b\b..." : "|", line->ini);
   else
-    puts("| ...\033[0m");
+    fputs("| ...\033[0m\n", cov->out);
 }
 
 static void terminal(Cov* cov, Data* d) {
-  if(isatty(fileno(cov->out)))
+  if(cov->tty)
     tty(cov, d);
   else
-    fprintf(cov->out, "%i\n", cov->lines[d->line_count].ini);
+    fprintf(cov->out, "%i\n", cov_line(cov, d->line_count)->ini);
 }
 
-void diagnostic(Cov* cov, cov_func func){
-  FILE * f;
-  Data d;
-  size_t len = 0;
+static int source_open(Source* src, const char* name) {
+  struct stat st;
+  const int fd = open(name, O_RDONLY);
+  memset(src, 0, sizeof(Source));
+  if(fd == -1)
+    return 0;
+  if(fstat(fd, &st)) {
+    close(fd);
+    return 0;
+  }
+  src->size = st.st_size;
+  if(src->size) {
+    void* map = mmap(NULL, src->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    src->src = map == MAP_FAILED ? NULL : map;
+  }
+  close(fd);
+  return !src->size || src->src;
+}
 
+static void source_index(Source* src) {
+  size_t cap = src->size / 32 + 2;
+  const char* p = src->src, *end = src->src + src->size;
+  src->off = malloc(cap * sizeof(size_t));
+  src->off[0] = 0;
+  while(p < end) {
+    const char* nl = memchr(p, '\n', end - p);
+    p = nl ? nl + 1 : end;
+    if(src->n + 2 > cap) {
+      cap *= 2;
+      src->off = realloc(src->off, cap * sizeof(size_t));
+    }
+    src->off[++src->n] = p - src->src;
+  }
+}
+
+// line i, counted from 0, without its newline
+static const char* source_line(const Source* src, const uint i, size_t* len) {
+  const size_t end = src->off[i + 1];
+  *len = end - src->off[i];
+  if(*len && src->src[end - 1] == '\n')
+    --*len;
+  return src->src + src->off[i];
+}
+
+static void source_close(Source* src) {
+  if(src->src)
+    munmap((void*)src->src, src->size);
+  free(src->off);
+}
+
+static void render(Cov* cov, const Source* src, cov_func func,
+    const uint from, const uint to) {
+  Data d;
   memset(&d, 0, sizeof(Data));
-  d.line_count = 1;
-  if(!(f = fopen(cov->base, "r")))
-    err(cov->base, cov->base);
-  while((d.s = getline(&d.line, &len, f)) != -1) {
+  for(uint i = from; i < to; i++) {
+    d.line = source_line(src, i, &d.s);
+    d.line_count = i + 1;
     func(cov, &d);
-    d.line_count++;
   }
-  fclose(f);
-  if(d.line)
-    free(d.line);
+}
+
+typedef struct {
+  char* buf;
+  size_t len;
+  int ready;
+} Chunk;
+
+// the lines of one file, rendered a chunk at a time by the workers
+// and written out in order by the caller as the chunks come in
+typedef struct {
+  const Cov* cov;
+  const Source* src;
+  cov_func func;
+  Chunk* chunk;
+  uint n, next, written, ahead;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} Render;
+
+static void* render_worker(void* data) {
+  Render* r = (Render*)data;
+  while(1) {
+    pthread_mutex_lock(&r->lock);
+    while(r->next < r->n && r->next >= r->written + r->ahead)
+      pthread_cond_wait(&r->cond, &r->lock);
+    const uint i = r->next++;
+    pthread_mutex_unlock(&r->lock);
+    if(i >= r->n)
+      return NULL;
+    Cov cov = *r->cov;
+    const uint to = (i + 1) * CHUNK_LINES;
+    cov.out = open_memstream(&r->chunk[i].buf, &r->chunk[i].len);
+    render(&cov, r->src, r->func, i * CHUNK_LINES,
+        to < r->src->n ? to : r->src->n);
+    fclose(cov.out);
+    pthread_mutex_lock(&r->lock);
+    r->chunk[i].ready = 1;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+  }
+}
+
+static void render_parallel(Cov* cov, const Source* src, cov_func func,
+    const uint jobs) {
+  Render r = { cov, src, func, NULL, (src->n + CHUNK_LINES - 1) / CHUNK_LINES,
+    0, 0, jobs * CHUNK_AHEAD, PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER };
+  pthread_t thread[jobs];
+  uint started = 0;
+  r.chunk = calloc(r.n, sizeof(Chunk));
+  while(started < jobs &&
+      !pthread_create(&thread[started], NULL, render_worker, &r))
+    started++;
+  // no thread: render in the caller's stead
+  if(!started) {
+    free(r.chunk);
+    render(cov, src, func, 0, src->n);
+    return;
+  }
+  for(uint i = 0; i < r.n; i++) {
+    pthread_mutex_lock(&r.lock);
+    while(!r.chunk[i].ready)
+      pthread_cond_wait(&r.cond, &r.lock);
+    r.written = i + 1;
+    pthread_cond_broadcast(&r.cond);
+    pthread_mutex_unlock(&r.lock);
+    fwrite(r.chunk[i].buf, 1, r.chunk[i].len, cov->out);
+    free(r.chunk[i].buf);
+  }
+  for(uint i = 0; i < started; i++)
+    pthread_join(thread[i], NULL);
+  free(r.chunk);
+}
+
+void diagnostic(Cov* cov, cov_func func, const uint jobs){
+  Source src;
+  StatClock clock;
+
+  stats_start(&clock);
+  if(!source_open(&src, cov->base))
+    err(cov->base, cov->base);
+  stats_stop(&clock, phase_open);
+  stats_start(&clock);
+  source_index(&src);
+  stats_stop(&clock, phase_parse);
+  stats_start(&clock);
+  cov->tty = isatty(fileno(cov->out));
+  if(cov->tty)
+    layout(cov);
+  if(jobs > 1 && src.n > CHUNK_LINES)
+    render_parallel(cov, &src, func, jobs);
+  else
+    render(cov, &src, func, 0, src.n);
+  stats_stop(&clock, phase_emit);
+  source_close(&src);
+}
+
+typedef struct {
+  FILE* out;
+  cov_func func;
+  int max_exec;
+  uint jobs;
+} Run;
+
+static void coverage(void* data, const char* base) {
+  Run* r = (Run*)data;
+  Cov c = { base, r->out, 1, r->max_exec, NULL, NULL, 0, 0, 0, 0 };
+  StatClock clock;
+  c.lines = calloc(MIN_LINE, sizeof(Line));
+  c. postfix = "da";
+  if(!run(&c, da))
+    missing(&c);
+  c. postfix = "cov";
+  if(!run(&c, co))
+    missing(&c);
+  diagnostic(&c, r->func, r->jobs);
+  stats_start(&clock);
+  free(c.lines);
+  stats_stop(&clock, phase_free);
+  r->max_exec = c.max_exec;
+}
+
+// a file of the pager, loaded the first time it is shown
+typedef struct {
+  char* base;
+  Cov cov;
+  Source src;
+  uint* cold;  // the lines that were never run, in order
+  uint* hot;   // the lines run at least half as often as the most run
+  uint ncold, nhot;
+  uint top;    // the first line shown, from 1
+  int loaded;
+  const char* missing;  // the postfix of the file that could not be read
+} View;
+
+typedef struct {
+  View* view;
+  uint n, cur;
+  int max_exec;
+} Pager;
+
+static struct termios pager_term;
+
+#define PAGER_LEAVE "\033[?25h\033[?1049l"
+
+static void pager_restore(void) {
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &pager_term);
+  fputs(PAGER_LEAVE, stdout);
+  fflush(stdout);
+}
+
+// atexit does not run when a signal kills us: put the terminal back first
+static void pager_signal(int sig) {
+  tcsetattr(STDIN_FILENO, TCSANOW, &pager_term);
+  if(write(STDOUT_FILENO, PAGER_LEAVE, sizeof(PAGER_LEAVE) - 1) < 0) {}
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+static void pager_add(void* data, const char* base) {
+  Pager* p = (Pager*)data;
+  p->view = realloc(p->view, (p->n + 1) * sizeof(View));
+  memset(&p->view[p->n], 0, sizeof(View));
+  p->view[p->n].base = strdup(base);
+  p->view[p->n++].top = 1;
+}
+
+static void view_load(View* v, Pager* p) {
+  Cov* c = &v->cov;
+  uint max = 0;
+  c->base = v->base;
+  c->out = stdout;
+  c->last = 1;
+  c->max_exec = p->max_exec;
+  c->lines = calloc(MIN_LINE, sizeof(Line));
+  v->loaded = 1;
+  c->postfix = "da";
+  if(!run(c, da)) {
+    v->missing = c->postfix;
+    return;
+  }
+  c->postfix = "cov";
+  if(!run(c, co)) {
+    v->missing = c->postfix;
+    return;
+  }
+  p->max_exec = c->max_exec;
+  if(!source_open(&v->src, v->base)) {
+    v->missing = "";
+    return;
+  }
+  source_index(&v->src);
+  for(uint i = 1; i <= v->src.n; i++)
+    if(cov_line(c, i)->ini > max)
+      max = cov_line(c, i)->ini;
+  v->cold = malloc(v->src.n * sizeof(uint));
+  v->hot = malloc(v->src.n * sizeof(uint));
+  for(uint i = 1; i <= v->src.n; i++) {
+    const Line* line = cov_line(c, i);
+    if(line->set && !line->ini)
+      v->cold[v->ncold++] = i;
+    else if(line->ini && line->ini * 2 >= max)
+      v->hot[v->nhot++] = i;
+  }
+}
+
+static void view_free(View* v) {
+  if(v->loaded) {
+    free(v->cov.lines);
+    source_close(&v->src);
+    free(v->cold);
+    free(v->hot);
+  }
+  free(v->base);
+}
+
+// the first of the list after line, or the last before it when back
+static uint view_jump(const uint* list, const uint n, const uint line,
+    const int back) {
+  uint lo = 0, hi = n;
+  while(lo < hi) {
+    const uint mid = lo + (hi - lo) / 2;
+    if(list[mid] < line + !back)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if(back)
+    return lo ? list[lo - 1] : line;
+  return lo < n ? list[lo] : line;
+}
+
+// only what fits on the screen is rendered, with a status line below
+static void view_draw(View* v, const uint rows, const uint cols) {
+  char status[256];
+  Data d;
+  memset(&d, 0, sizeof(Data));
+  fputs("\033[H\033[2J", stdout);
+  layout(&v->cov);
+  for(uint i = v->top; i < v->top + rows && i <= v->src.n; i++) {
+    d.line = source_line(&v->src, i - 1, &d.s);
+    d.line_count = i;
+    tty(&v->cov, &d);
+  }
+  const int len = v->missing ?
+    snprintf(status, sizeof(status), " %s%s: no such file"
+      "  n/p:file  q:quit ", v->base, v->missing) :
+    snprintf(status, sizeof(status), " %s %u-%u/%u, %u not run,"
+      " %u hot  u/U:not run  h/H:hot  n/p:file  q:quit ", v->base, v->top,
+      v->top + rows - 1 < v->src.n ? v->top + rows - 1 : v->src.n,
+      v->src.n, v->ncold, v->nhot);
+  printf("\033[%u;1H\033[7m%.*s\033[0m", rows + 1,
+      (uint)len < cols ? len : (int)cols, status);
+  fflush(stdout);
+}
+
+static int pager_key(void) {
+  char buf[8];
+  const ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+  if(n <= 0)
+    return 'q';
+  if(n >= 3 && buf[0] == '\033' && buf[1] == '[') {
+    switch(buf[2]) {
+      case 'A': return 'k';
+      case 'B': return 'j';
+      case 'H': return 'g';
+      case 'F': return 'G';
+      case '5': return 'b';
+      case '6': return ' ';
+    }
+    return 0;
+  }
+  return *buf;
+}
+
+static void pager(Pager* p) {
+  struct termios raw;
+  struct winsize w;
+  struct sigaction sa;
+  tcgetattr(STDIN_FILENO, &pager_term);
+  raw = pager_term;
+  // ^C comes in as a key, and quits the way q does
+  raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+  atexit(pager_restore);
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = pager_signal;
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGHUP, &sa, NULL);
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+  fputs("\033[?1049h\033[?25l", stdout);
+  while(1) {
+    View* v = &p->view[p->cur];
+    if(!v->loaded)
+      view_load(v, p);
+    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+    const uint rows = w.ws_row > 1 ? w.ws_row - 1 : 1;
+    const uint last = v->src.n > rows ? v->src.n - rows + 1 : 1;
+    view_draw(v, rows, w.ws_col);
+    switch(pager_key()) {
+      case 'q': case '\003':
+        return;
+      case 'j': case '\n':
+        if(v->top < last)
+          v->top++;
+        break;
+      case 'k':
+        if(v->top > 1)
+          v->top--;
+        break;
+      case ' ': case 'f':
+        v->top = v->top + rows < last ? v->top + rows : last;
+        break;
+      case 'b':
+        v->top = v->top > rows ? v->top - rows : 1;
+        break;
+      case 'g':
+        v->top = 1;
+        break;
+      case 'G':
+        v->top = last;
+        break;
+      case 'u':
+        v->top = view_jump(v->cold, v->ncold, v->top, 0);
+        break;
+      case 'U':
+        v->top = view_jump(v->cold, v->ncold, v->top, 1);
+        break;
+      case 'h':
+        v->top = view_jump(v->hot, v->nhot, v->top, 0);
+        break;
+      case 'H':
+        v->top = view_jump(v->hot, v->nhot, v->top, 1);
+        break;
+      case 'n':
+        if(p->cur + 1 < p->n)
+          p->cur++;
+        break;
+      case 'p':
+        if(p->cur)
+          p->cur--;
+        break;
+    }
+    if(v->top > last)
+      v->top = last;
+  }
 }
 
 int main(int argc, char** argv) {
-  int max_exec = 0;
-  cov_func func = terminal;
-  FILE* out = stdout;
+  Run r = { stdout, terminal, 0, 1 };
+  Pager p = { NULL, 0, 0, 0 };
+  int ret = EXIT_SUCCESS, page = 0;
   argv++;
   argc--;
   while(argc) {
-    Cov c = { *argv, out, 1, max_exec, NULL, NULL };
-    c.lines = calloc(MIN_LINE, sizeof(Line));
-    c. postfix = "da";
-    run(&c, da);
-    c. postfix = "cov";
-    run(&c, co);
-    diagnostic(&c, func);
-    free(c.lines);
+    if(!strcmp(*argv, "--stats"))
+      stats_init("gwcov");
+    else if(!strcmp(*argv, "--pager"))
+      page = 1;
+    else if(!strcmp(*argv, "-j") && argc > 1) {
+      r.jobs = strtoul(*++argv, NULL, 10);
+      argc--;
+    }
+    else if(!strcmp(*argv, "--files-from") && argc > 1) {
+      if(!files_from(*++argv, pager_add, &p))
+        ret = EXIT_FAILURE;
+      argc--;
+    } else
+      pager_add(&p, *argv);
     argc--;
     argv++;
-    max_exec = c.max_exec;
   }
-  exit(EXIT_SUCCESS);
+  if(page && p.n && isatty(STDIN_FILENO) && isatty(STDOUT_FILENO))
+    pager(&p);
+  else
+    for(uint i = 0; i < p.n; i++)
+      coverage(&r, p.view[i].base);
+  for(uint i = 0; i < p.n; i++)
+    view_free(&p.view[i]);
+  free(p.view);
+  stats_report(stderr);
+  exit(ret);
 }
@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// synthetic gwion programs for the benchmarks: the same seed, size and
+// depth always give the same corpus, byte for byte.
+typedef struct {
+  FILE*    file;
+  uint64_t rand;
+  unsigned depth;  // deepest nesting of statements and expressions
+  unsigned indent;
+  unsigned id;     // numbers the names declared in the file
+} Gen;
+
+static const char* type[] = { "int", "float", "dur", "time", "string", "Object" };
+#define TYPES (sizeof(type) / sizeof(*type))
+
+static const char* binop[] = { "+", "-", "*", "/", "%", "==", "!=", "<", ">",
+  "&&", "||", "=>", "@=>", "+=>" };
+#define BINOPS (sizeof(binop) / sizeof(*binop))
+
+// xorshift64*: cheap and the same on every libc
+static unsigned gen_rand(Gen* gen, const unsigned n) {
+  gen->rand ^= gen->rand >> 12;
+  gen->rand ^= gen->rand << 25;
+  gen->rand ^= gen->rand >> 27;
+  return (unsigned)((gen->rand * 0x2545F4914F6CDD1DULL) >> 32) % n;
+}
+
+static void gen_indent(Gen* gen) {
+  for(unsigned i = 0; i < gen->indent; i++)
+    fputs("  ", gen->file);
+}
+
+static void gen_exp(Gen* gen, const unsigned depth);
+
+static void gen_primary(Gen* gen) {
+  switch(gen_rand(gen, 9)) {
+    case 0:
+      fprintf(gen->file, "%u", gen_rand(gen, 1000));
+      break;
+    case 1:
+      fprintf(gen->file, "%u.%u", gen_rand(gen, 100), gen_rand(gen, 100));
+      break;
+    case 2:
+      fprintf(gen->file, "\"s%u\"", gen_rand(gen, 1000));
+      break;
+    case 3:
+      fprintf(gen->file, "'%c'", 'a' + gen_rand(gen, 26));
+      break;
+    case 4:
+      fprintf(gen->file, "#(%u, %u)", gen_rand(gen, 10), gen_rand(gen, 10));
+      break;
+    case 5:
+      fprintf(gen->file, "%%(%u, 0.%u)", gen_rand(gen, 10), gen_rand(gen, 10));
+      break;
+    case 6:
+      fprintf(gen->file, "@(%u, %u, %u)", gen_rand(gen, 10), gen_rand(gen, 10),
+          gen_rand(gen, 10));
+      break;
+    case 7:
+      fprintf(gen->file, "[%u, %u]", gen_rand(gen, 10), gen_rand(gen, 10));
+      break;
+    default:
+      fprintf(gen->file, "v%u", gen_rand(gen, gen->id + 1));
+      break;
+  }
+}
+
+static void gen_exp(Gen* gen, const unsigned depth) {
+  if(!depth) {
+    gen_primary(gen);
+    return;
+  }
+  switch(gen_rand(gen, 12)) {
+    case 0:
+    case 1:
+      gen_exp(gen, depth - 1);
+      fprintf(gen->file, " %s ", binop[gen_rand(gen, BINOPS)]);
+      gen_exp(gen, depth - 1);
+      break;
+    case 2:
+      fputs("(", gen->file);
+      gen_exp(gen, depth - 1);
+      fputs(" ? ", gen->file);
+      gen_exp(gen, depth - 1);
+      fputs(" : ", gen->file);
+      gen_exp(gen, depth - 1);
+      fputs(")", gen->file);
+      break;
+    case 3:
+      fprintf(gen->file, "f%u(", gen_rand(gen, gen->id + 1));
+      gen_exp(gen, depth - 1);
+      fputs(", ", gen->file);
+      gen_exp(gen, depth - 1);
+      fputs(")", gen->file);
+      break;
+    case 4:
+      fprintf(gen->file, "v%u.m%u", gen_rand(gen, gen->id + 1), gen_rand(gen, 8));
+      break;
+    case 5:
+      fprintf(gen->file, "v%u[", gen_rand(gen, gen->id + 1));
+      gen_exp(gen, depth - 1);
+      fputs("]", gen->file);
+      break;
+    case 6:
+      fputs("(", gen->file);
+      gen_exp(gen, depth - 1);
+      fprintf(gen->file, " $ %s)", type[gen_rand(gen, 2)]);
+      break;
+    case 7:
+      fprintf(gen->file, "%u::second", gen_rand(gen, 10) + 1);
+      break;
+    case 8:
+      fprintf(gen->file, "%sv%u", gen_rand(gen, 2) ? "++" : "--",
+          gen_rand(gen, gen->id + 1));
+      break;
+    case 9:
+      fprintf(gen->file, "new %s", gen_rand(gen, 2) ? "Object" : "Event");
+      break;
+    case 10:
+      fprintf(gen->file, "“%s”f%u(", type[gen_rand(gen, TYPES)],
+          gen_rand(gen, gen->id + 1));
+      gen_exp(gen, depth - 1);
+      fputs(")", gen->file);
+      break;
+    default:
+      fprintf(gen->file, "v%u%s", gen_rand(gen, gen->id + 1),
+          gen_rand(gen, 2) ? "++" : "--");
+      break;
+  }
+}
+
+static void gen_stmt(Gen* gen, const unsigned depth);
+
+static void gen_block(Gen* gen, const unsigned depth) {
+  const unsigned n = 1 + gen_rand(gen, 4);
+  fputs("{\n", gen->file);
+  gen->indent++;
+  for(unsigned i = 0; i < n; i++)
+    gen_stmt(gen, depth);
+  gen->indent--;
+  gen_indent(gen);
+  fputs("}\n", gen->file);
+}
+
+static void gen_decl(Gen* gen) {
+  const unsigned t = gen_rand(gen, TYPES + 1);
+  if(t == TYPES)
+    fprintf(gen->file, "typeof v%u v%u", gen_rand(gen, gen->id + 1), gen->id + 1);
+  else
+    fprintf(gen->file, "%s%s v%u", type[t], t == TYPES - 1 ? " @" : "",
+        gen->id + 1);
+  ++gen->id;
+  if(!gen_rand(gen, 4))
+    fprintf(gen->file, "[%u]", 1 + gen_rand(gen, 8));
+}
+
+static void gen_stmt(Gen* gen, const unsigned depth) {
+  gen_indent(gen);
+  if(!depth) {
+    gen_exp(gen, gen->depth);
+    fputs(";\n", gen->file);
+    return;
+  }
+  switch(gen_rand(gen, 15)) {
+    case 0:
+      fputs("if(", gen->file);
+      gen_exp(gen, depth - 1);
+      fputs(") ", gen->file);
+      gen_block(gen, depth - 1);
+      if(gen_rand(gen, 2)) {
+        gen_indent(gen);
+        fputs("else ", gen->file);
+        gen_block(gen, depth - 1);
+      }
+      break;
+    case 1:
+      fprintf(gen->file, "%s(", gen_rand(gen, 2) ? "while" : "until");
+      gen_exp(gen, depth - 1);
+      fputs(") ", gen->file);
+      gen_block(gen, depth - 1);
+      break;
+    case 2:
+      fputs("do ", gen->file);
+      gen_block(gen, depth - 1);
+      gen_indent(gen);
+      fputs("while(", gen->file);
+      gen_exp(gen, depth - 1);
+      fputs(");\n", gen->file);
+      break;
+    case 3:
+      fprintf(gen->file, "for(int i%u; i%u < %u; ++i%u) ", depth, depth,
+          gen_rand(gen, 100), depth);
+      gen_block(gen, depth - 1);
+      break;
+    case 4:
+      fprintf(gen->file, "for(auto a%u : v%u) ", depth, gen_rand(gen, gen->id + 1));
+      gen_block(gen, depth - 1);
+      break;
+    case 5:
+      fprintf(gen->file, "repeat(%u) ", gen_rand(gen, 16));
+      gen_block(gen, depth - 1);
+      break;
+    case 6:
+      fputs("switch(", gen->file);
+      gen_exp(gen, depth - 1);
+      fputs(") {\n", gen->file);
+      for(unsigned i = 0, n = 1 + gen_rand(gen, 3); i < n; i++) {
+        gen_indent(gen);
+        fprintf(gen->file, "case %u:\n", i);
+        gen->indent++;
+        gen_stmt(gen, depth - 1);
+        gen_indent(gen);
+        fputs("break;\n", gen->file);
+        gen->indent--;
+      }
+      gen_indent(gen);
+      fputs("}\n", gen->file);
+      break;
+    case 7:
+      gen_block(gen, depth - 1);
+      break;
+    case 8:
+      fputs("<<< ", gen->file);
+      gen_exp(gen, depth - 1);
+      fputs(" >>>;\n", gen->file);
+      break;
+    case 9:
+      fprintf(gen->file, "spork ~ f%u(", gen_rand(gen, gen->id + 1));
+      gen_exp(gen, depth - 1);
+      fputs(");\n", gen->file);
+      break;
+    case 10:
+      fprintf(gen->file, "// note %u\n", gen_rand(gen, 1000));
+      break;
+    case 11:
+      fprintf(gen->file, "l%u:\n", ++gen->id);
+      gen_indent(gen);
+      fprintf(gen->file, "goto l%u;\n", gen->id);
+      break;
+    default:
+      if(gen_rand(gen, 2)) {
+        gen_exp(gen, depth);
+        fputs(" => ", gen->file);
+      }
+      gen_decl(gen);
+      fputs(";\n", gen->file);
+      break;
+  }
+}
+
+static void gen_args(Gen* gen, const unsigned n) {
+  for(unsigned i = 0; i < n; i++)
+    fprintf(gen->file, "%s%s a%u", i ? ", " : "", type[gen_rand(gen, TYPES)], i);
+}
+
+static void gen_func(Gen* gen, const unsigned tmpl) {
+  gen_indent(gen);
+  if(tmpl)
+    fputs("template<~A~>\n", gen->file);
+  gen_indent(gen);
+  fprintf(gen->file, "%s %s%s f%u(", tmpl || gen_rand(gen, 6) ?
+      "function" : "variadic", gen_rand(gen, 4) ? "" : "static ",
+      tmpl ? "A" : type[gen_rand(gen, TYPES)], ++gen->id);
+  gen_args(gen, gen_rand(gen, 4));
+  fputs(") ", gen->file);
+  gen_block(gen, gen->depth);
+}
+
+static void gen_fptr(Gen* gen) {
+  gen_indent(gen);
+  fprintf(gen->file, "typedef %s f%u(", type[gen_rand(gen, TYPES)], ++gen->id);
+  gen_args(gen, 1 + gen_rand(gen, 3));
+  fputs(gen_rand(gen, 4) ? ");\n" : ", ...);\n", gen->file);
+}
+
+// members of a class may be private or static
+static const char* gen_flag(Gen* gen, const unsigned class_depth) {
+  static const char* flag[] = { "", "", "private ", "static " };
+  return class_depth ? flag[gen_rand(gen, 4)] : "";
+}
+
+static void gen_union(Gen* gen, const unsigned class_depth) {
+  gen_indent(gen);
+  fprintf(gen->file, "%sunion {\n", gen_flag(gen, class_depth));
+  for(unsigned i = 0, n = 2 + gen_rand(gen, 3); i < n; i++) {
+    gen_indent(gen);
+    fprintf(gen->file, "  %s m%u;\n", type[gen_rand(gen, TYPES - 1)], i);
+  }
+  gen_indent(gen);
+  fprintf(gen->file, "} v%u;\n", ++gen->id);
+}
+
+static void gen_enum(Gen* gen) {
+  const unsigned id = ++gen->id;
+  gen_indent(gen);
+  fputs("enum {", gen->file);
+  for(unsigned i = 0, n = 2 + gen_rand(gen, 6); i < n; i++)
+    fprintf(gen->file, "%s e%u_%u", i ? "," : "", id, i);
+  fprintf(gen->file, " } v%u;\n", id);
+}
+
+static void gen_section(Gen* gen, const unsigned class_depth);
+
+static void gen_class(Gen* gen, const unsigned class_depth) {
+  const unsigned tmpl = !gen_rand(gen, 4);
+  gen_indent(gen);
+  if(tmpl)
+    fputs("template<~A~>\n", gen->file);
+  gen_indent(gen);
+  fprintf(gen->file, "class C%u", ++gen->id);
+  if(gen_rand(gen, 2))
+    fputs(" extends Object", gen->file);
+  fputs(" {\n", gen->file);
+  gen->indent++;
+  for(unsigned i = 0, n = 2 + gen_rand(gen, 6); i < n; i++)
+    gen_section(gen, class_depth + 1);
+  gen->indent--;
+  gen_indent(gen);
+  fputs("}\n", gen->file);
+}
+
+static void gen_section(Gen* gen, const unsigned class_depth) {
+  switch(gen_rand(gen, 11)) {
+    case 0:
+      if(class_depth < 2) {
+        gen_class(gen, class_depth);
+        break;
+      }
+      // fall through
+    case 1:
+    case 2:
+      gen_func(gen, 0);
+      break;
+    case 3:
+      gen_func(gen, 1);
+      break;
+    case 4:
+      gen_fptr(gen);
+      break;
+    case 5:
+      gen_union(gen, class_depth);
+      break;
+    case 6:
+      gen_enum(gen);
+      break;
+    case 7:
+      gen_indent(gen);
+      fprintf(gen->file, "typedef %s t%u;\n", type[gen_rand(gen, TYPES)], ++gen->id);
+      break;
+    case 8:
+      if(class_depth) {
+        gen_indent(gen);
+        fputs(gen_flag(gen, class_depth), gen->file);
+        gen_decl(gen);
+        fputs(";\n", gen->file);
+        break;
+      }
+      // fall through
+    default:
+      gen_stmt(gen, gen->depth);
+      break;
+  }
+}
+
+// a file includes a few of the ones before it, so the graph has no cycle
+static int gen_file(const char* name, const unsigned long index,
+    const uint64_t seed, const long size, const unsigned depth) {
+  Gen gen = { fopen(name, "w"), seed * 0x9E3779B97F4A7C15ULL + 1, depth, 0, 0 };
+  if(!gen.file) {
+    perror(name);
+    return 0;
+  }
+  for(unsigned i = 0, n = index ? 1 + gen_rand(&gen, 3) : 0; i < n; i++)
+    fprintf(gen.file, "#include \"gen%04u.gw\"\n", gen_rand(&gen, index));
+  while(ftell(gen.file) < size)
+    gen_section(&gen, 0);
+  fclose(gen.file);
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  unsigned long files = 100, depth = 4, seed = 1;
+  long size = 16384;
+  const char* dir = ".";
+  argc--; argv++;
+  while(argc--) {
+    if(!strcmp(*argv, "-n") && argc) {
+      files = strtoul(*++argv, NULL, 10);
+      argc--;
+    } else if(!strcmp(*argv, "-s") && argc) {
+      size = strtol(*++argv, NULL, 10);
+      argc--;
+    } else if(!strcmp(*argv, "-d") && argc) {
+      depth = strtoul(*++argv, NULL, 10);
+      argc--;
+    } else if(!strcmp(*argv, "-S") && argc) {
+      seed = strtoul(*++argv, NULL, 10);
+      argc--;
+    } else if(!strcmp(*argv, "-o") && argc) {
+      dir = *++argv;
+      argc--;
+    } else {
+      fprintf(stderr, "usage: gwgen [-n files] [-s bytes] [-d depth] "
+          "[-S seed] [-o dir]\n");
+      return 2;
+    }
+    ++argv;
+  }
+  mkdir(dir, 0777);
+  for(unsigned long i = 0; i < files; i++) {
+    char name[strlen(dir) + 16];
+    sprintf(name, "%s/gen%04lu.gw", dir, i);
+    if(!gen_file(name, i, seed + i, size, depth))
+      return 1;
+  }
+  return 0;
+}
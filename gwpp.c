@@ -1,33 +1,49 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include "defs.h"
 #include "map.h"
 #include "absyn.h"
 #include "hash.h"
 #include "scanner.h"
+#include "astview.h"
+#include "gwpp.h"
+#include "cache.h"
+#include "stats.h"
+#include "prefetch.h"
+#include "arena.h"
+#include "scan.h"
+#include "tagfile.h"
+#include "pool.h"
 
 #define TABLEN 2
 
 extern m_str op2str(Operator);
 
 typedef struct {
-  const m_str name;
-  FILE*  file;
-  m_uint line, pos;
-  m_uint indent;
-  m_bool skip;
-  m_bool nonl;
-  m_bool comment;
-} Linter;
-
-ANN static void lint_type_decl(Linter* linter, Type_Decl* type);
-ANN static void lint_exp(Linter* linter, Exp exp);
-ANN static void lint_stmt(Linter* linter, Stmt stmt);
-ANN static void lint_stmt_if(Linter* linter, Stmt_If stmt);
-ANN static void lint_stmt_list(Linter* linter, Stmt_List list);
-ANN static void lint_class_def(Linter* linter, Class_Def class_def);
+  Linter linter;
+  Section* section;
+  char* buf;
+  size_t len;
+} Part;
+
+typedef struct {
+  Part* part;
+  m_uint n;
+  m_uint next;
+} Work;
+
+ANN static void lint_type_decl(Linter* linter, const Type_Decl* type);
+ANN static void lint_exp(Linter* linter, CExp exp);
+ANN static void lint_exp_one(Linter* linter, CExp exp);
+ANN static void lint_stmt(Linter* linter, CStmt stmt);
+ANN static void lint_stmt_if(Linter* linter, CStmt_If stmt);
+ANN static void lint_stmt_list(Linter* linter, CStmt_List list);
+ANN static void lint_class_def(Linter* linter, CClass_Def class_def);
 
 ANN static void lint_print(Linter* linter, const char* fmt, ...) {
   va_list arg;
@@ -36,13 +52,24 @@ ANN static void lint_print(Linter* linter, const char* fmt, ...) {
   va_end(arg);
 }
 
+ANN static void lint_long_line(const m_str name, const m_uint line,
+    const m_uint pos, const m_uint prev) {
+  fprintf(stderr, "'\033[31;1m%s\033[0m' long line %" INT_F "%" INT_F " %" INT_F "\n",
+      name, line, pos, prev);
+}
+
 ANN static void lint_nl(Linter* linter) {
   const m_uint pos = linter->pos;
   fprintf(linter->file, "\n");
   linter->pos = ftell(linter->file);
-  if((m_int)linter->pos - (m_int)pos > 80)
-    fprintf(stderr, "'\033[31;1m%s\033[0m' long line %" INT_F "%" INT_F " %" INT_F "\n",
-        linter->name, linter->line, linter->pos, pos);
+  if((m_int)linter->pos - (m_int)pos > 80) {
+    if(linter->warn) {
+      vector_add(linter->warn, (vtype)linter->line);
+      vector_add(linter->warn, (vtype)linter->pos);
+      vector_add(linter->warn, (vtype)pos);
+    } else
+      lint_long_line(linter->name, linter->line, linter->pos, pos);
+  }
   linter->line++;
 }
 
@@ -57,7 +84,7 @@ ANN static void lint_indent(Linter* linter) {
       lint_print(linter, " ");
 }
 
-ANN static void lint_id_list(Linter* linter, ID_List list) {
+ANN static void lint_id_list(Linter* linter, CID_List list) {
   const m_bool next = list->next ? 1 : 0;
   if(next)
     lint_print(linter, "<");
@@ -70,27 +97,21 @@ ANN static void lint_id_list(Linter* linter, ID_List list) {
     lint_print(linter, ">");
 }
 
-ANN static void lint_array(Linter* linter, Array_Sub array) {
-  Exp exp = array->exp;
+ANN static void lint_array(Linter* linter, CArray_Sub array) {
+  CExp exp = array->exp;
   for(m_uint i = 0; i < array->depth; i++) {
-    Exp tmp = exp ? exp->next : NULL;
-    if(exp)
-      exp->next = NULL;
     lint_print(linter, "[");
-    if(exp)
-     lint_exp(linter, exp);
-    lint_print(linter, "]");
     if(exp) {
-      exp->next = tmp;
-      exp = tmp;
+      lint_exp_one(linter, exp);
+      exp = exp->next;
     }
+    lint_print(linter, "]");
   }
 }
 
-ANN static void lint_array_lit(Linter* linter, Array_Sub array) {
-  Exp exp = array->exp;
+ANN static void lint_array_lit(Linter* linter, CArray_Sub array) {
+  CExp exp = array->exp;
   for(m_uint i = 0; i < array->depth; i++) {
-    Exp tmp = exp ? exp->next : NULL;
     lint_print(linter, "[");
     if(exp) {
       if(exp->exp_type == ae_exp_primary &&
@@ -102,13 +123,10 @@ ANN static void lint_array_lit(Linter* linter, Array_Sub array) {
         lint_print(linter, " ");
     }
     lint_print(linter, "]");
-    if(exp) {
-      exp->next = tmp;
-    }
   }
 }
 
-ANN static void lint_type_list(Linter* linter, Type_List list) {
+ANN static void lint_type_list(Linter* linter, CType_List list) {
   lint_print(linter, "“");
   do {
     lint_type_decl(linter, list->td);
@@ -118,7 +136,7 @@ ANN static void lint_type_list(Linter* linter, Type_List list) {
   lint_print(linter, "”");
 }
 
-ANN static void lint_type_decl(Linter* linter, Type_Decl* type) {
+ANN static void lint_type_decl(Linter* linter, const Type_Decl* type) {
   if(GET_FLAG(type, private))
     lint_print(linter, "private ");
   if(GET_FLAG(type, static))
@@ -137,7 +155,7 @@ ANN static void lint_type_decl(Linter* linter, Type_Decl* type) {
     lint_array(linter, type->array);
 }
 
-static void lint_stmt_indent(Linter* linter, Stmt stmt) {
+static void lint_stmt_indent(Linter* linter, CStmt stmt) {
   if(stmt->stmt_type == ae_stmt_if) {
     lint_print(linter, " ");
     lint_stmt_if(linter, &stmt->d.stmt_if);
@@ -152,7 +170,7 @@ static void lint_stmt_indent(Linter* linter, Stmt stmt) {
     linter->indent--;
 }
 
-ANN static void lint_exp_decl(Linter* linter, Exp_Decl* decl) {
+ANN static void lint_exp_decl(Linter* linter, const Exp_Decl* decl) {
   Var_Decl_List list = decl->list;
   lint_type_decl(linter, decl->td);
   lint_print(linter, " ");
@@ -165,7 +183,7 @@ ANN static void lint_exp_decl(Linter* linter, Exp_Decl* decl) {
   } while((list = list->next));
 }
 
-ANN static void lint_exp_unary(Linter* linter, Exp_Unary* unary) {
+ANN static void lint_exp_unary(Linter* linter, const Exp_Unary* unary) {
   lint_print(linter, "%s", op2str(unary->op));
   switch(unary->op) {
     case op_inc:
@@ -186,13 +204,13 @@ ANN static void lint_exp_unary(Linter* linter, Exp_Unary* unary) {
   }
 }
 
-ANN static void lint_exp_binary(Linter* linter, Exp_Binary* binary) {
+ANN static void lint_exp_binary(Linter* linter, const Exp_Binary* binary) {
   lint_exp(linter, binary->lhs);
   lint_print(linter, " %s ", op2str(binary->op));
   lint_exp(linter, binary->rhs);
 }
 
-ANN static void lint_exp_primary(Linter* linter, Exp_Primary* exp) {
+ANN static void lint_exp_primary(Linter* linter, const Exp_Primary* exp) {
   switch(exp->primary_type) {
     case ae_primary_id:
       lint_print(linter, "%s", s_name(exp->d.var));
@@ -242,29 +260,29 @@ ANN static void lint_exp_primary(Linter* linter, Exp_Primary* exp) {
   }
 }
 
-ANN static void lint_exp_array(Linter* linter, Exp_Array* array) {
+ANN static void lint_exp_array(Linter* linter, const Exp_Array* array) {
   lint_exp(linter, array->base);
   lint_exp(linter, array->array->exp);
 }
 
-ANN static void lint_exp_cast(Linter* linter, Exp_Cast* cast) {
+ANN static void lint_exp_cast(Linter* linter, const Exp_Cast* cast) {
   lint_exp(linter, cast->exp);
   lint_print(linter, "$ ");
   lint_type_decl(linter, cast->td);
 }
 
-ANN static void lint_exp_post(Linter* linter, Exp_Postfix* post) {
+ANN static void lint_exp_post(Linter* linter, const Exp_Postfix* post) {
   lint_exp(linter, post->exp);
   lint_print(linter, "%s", op2str(post->op));
 }
 
-ANN static void lint_exp_dur(Linter* linter, Exp_Dur* dur) {
+ANN static void lint_exp_dur(Linter* linter, const Exp_Dur* dur) {
   lint_exp(linter, dur->base);
   lint_print(linter, "::");
   lint_exp(linter, dur->unit);
 }
 
-ANN static void lint_exp_call(Linter* linter, Exp_Call* exp_call) {
+ANN static void lint_exp_call(Linter* linter, const Exp_Call* exp_call) {
   if(exp_call->tmpl)
     lint_type_list(linter, exp_call->tmpl->types);
   lint_exp(linter, exp_call->func);
@@ -274,12 +292,12 @@ ANN static void lint_exp_call(Linter* linter, Exp_Call* exp_call) {
   lint_print(linter, ")");
 }
 
-ANN static void  lint_exp_dot(Linter* linter, Exp_Dot* member) {
+ANN static void  lint_exp_dot(Linter* linter, const Exp_Dot* member) {
   lint_exp(linter, member->base);
   lint_print(linter, ".%s", s_name(member->xid));
 }
 
-ANN static void lint_exp_if(Linter* linter, Exp_If* exp_if) {
+ANN static void lint_exp_if(Linter* linter, const Exp_If* exp_if) {
   lint_exp(linter, exp_if->cond);
   lint_print(linter, " ? ");
   lint_exp(linter, exp_if->if_exp);
@@ -287,52 +305,56 @@ ANN static void lint_exp_if(Linter* linter, Exp_If* exp_if) {
   lint_exp(linter, exp_if->else_exp);
 }
 
-ANN static void lint_exp(Linter* linter, Exp exp) {
+ANN static void lint_exp_one(Linter* linter, CExp exp) {
+  switch(exp->exp_type) {
+    case ae_exp_primary:
+      lint_exp_primary(linter, &exp->d.exp_primary);
+      break;
+    case ae_exp_decl:
+      lint_exp_decl(linter, &exp->d.exp_decl);
+      break;
+    case ae_exp_unary:
+      lint_exp_unary(linter, &exp->d.exp_unary);
+      break;
+    case ae_exp_binary:
+      lint_exp_binary(linter, &exp->d.exp_binary);
+      break;
+    case ae_exp_post:
+      lint_exp_post(linter, &exp->d.exp_post);
+      break;
+    case ae_exp_cast:
+      lint_exp_cast(linter, &exp->d.exp_cast);
+      break;
+    case ae_exp_call:
+      lint_exp_call(linter, &exp->d.exp_call);
+      break;
+    case ae_exp_array:
+      lint_exp_array(linter, &exp->d.exp_array);
+      break;
+    case ae_exp_dot:
+      lint_exp_dot(linter, &exp->d.exp_dot);
+      break;
+    case ae_exp_dur:
+      lint_exp_dur(linter, &exp->d.exp_dur);
+      break;
+    case ae_exp_if:
+      lint_exp_if(linter, &exp->d.exp_if);
+      break;
+    default:
+      break;
+  }
+}
+
+ANN static void lint_exp(Linter* linter, CExp exp) {
   while(exp) {
-    switch(exp->exp_type) {
-      case ae_exp_primary:
-        lint_exp_primary(linter, &exp->d.exp_primary);
-        break;
-      case ae_exp_decl:
-        lint_exp_decl(linter, &exp->d.exp_decl);
-        break;
-      case ae_exp_unary:
-        lint_exp_unary(linter, &exp->d.exp_unary);
-        break;
-      case ae_exp_binary:
-        lint_exp_binary(linter, &exp->d.exp_binary);
-        break;
-      case ae_exp_post:
-        lint_exp_post(linter, &exp->d.exp_post);
-        break;
-      case ae_exp_cast:
-        lint_exp_cast(linter, &exp->d.exp_cast);
-        break;
-      case ae_exp_call:
-        lint_exp_call(linter, &exp->d.exp_call);
-        break;
-      case ae_exp_array:
-        lint_exp_array(linter, &exp->d.exp_array);
-        break;
-      case ae_exp_dot:
-        lint_exp_dot(linter, &exp->d.exp_dot);
-        break;
-      case ae_exp_dur:
-        lint_exp_dur(linter, &exp->d.exp_dur);
-        break;
-      case ae_exp_if:
-        lint_exp_if(linter, &exp->d.exp_if);
-        break;
-      default:
-        break;
-    }
+    lint_exp_one(linter, exp);
     exp = exp->next;
     if(exp)
       lint_print(linter, ", ");
   };
 }
 
-ANN static void lint_stmt_code(Linter* linter, Stmt_Code stmt) {
+ANN static void lint_stmt_code(Linter* linter, CStmt_Code stmt) {
   if(!stmt->stmt_list) {
     lint_print(linter, "{}");
     return;
@@ -348,7 +370,7 @@ ANN static void lint_stmt_code(Linter* linter, Stmt_Code stmt) {
   lint_nl(linter);
 }
 
-ANN static void lint_stmt_return(Linter* linter, Stmt_Exp stmt) {
+ANN static void lint_stmt_return(Linter* linter, CStmt_Exp stmt) {
   lint_print(linter, "return");
   if(stmt->val) {
     lint_print(linter, " ");
@@ -358,7 +380,7 @@ ANN static void lint_stmt_return(Linter* linter, Stmt_Exp stmt) {
   lint_nl(linter);
 }
 
-ANN static void lint_stmt_flow(Linter* linter, struct Stmt_Flow_* stmt, const m_str str) {
+ANN static void lint_stmt_flow(Linter* linter, CStmt_Flow stmt, const m_str str) {
   if(!stmt->is_do) {
     lint_print(linter, "%s(", str);
     lint_exp(linter, stmt->cond);
@@ -376,7 +398,7 @@ ANN static void lint_stmt_flow(Linter* linter, struct Stmt_Flow_* stmt, const m_
   }
 }
 
-ANN static void lint_stmt_for(Linter* linter, Stmt_For stmt) {
+ANN static void lint_stmt_for(Linter* linter, CStmt_For stmt) {
   lint_print(linter, "for(");
   linter->nonl++;
   lint_stmt(linter, stmt->c1);
@@ -390,7 +412,7 @@ ANN static void lint_stmt_for(Linter* linter, Stmt_For stmt) {
   lint_stmt_indent(linter, stmt->body);
 }
 
-ANN static void lint_stmt_auto(Linter* linter, Stmt_Auto stmt) {
+ANN static void lint_stmt_auto(Linter* linter, CStmt_Auto stmt) {
   lint_print(linter, "for(");
   lint_print(linter, "auto ");
   lint_print(linter, s_name(stmt->sym));
@@ -400,27 +422,27 @@ ANN static void lint_stmt_auto(Linter* linter, Stmt_Auto stmt) {
   lint_stmt_indent(linter, stmt->body);
 }
 
-ANN static void lint_stmt_loop(Linter* linter, Stmt_Loop stmt) {
+ANN static void lint_stmt_loop(Linter* linter, CStmt_Loop stmt) {
   lint_print(linter, "repeat(");
   lint_exp(linter, stmt->cond);
   lint_print(linter, ")");
   lint_stmt(linter, stmt->body);
 }
 
-ANN static void lint_stmt_switch(Linter* linter, Stmt_Switch stmt) {
+ANN static void lint_stmt_switch(Linter* linter, CStmt_Switch stmt) {
   lint_print(linter, "switch(");
   lint_exp(linter, stmt->val);
   lint_print(linter, ")");
 }
 
-ANN static void lint_stmt_case(Linter* linter, Stmt_Exp stmt) {
+ANN static void lint_stmt_case(Linter* linter, CStmt_Exp stmt) {
   lint_print(linter, "case ");
   lint_exp(linter, stmt->val);
   lint_print(linter, ":");
   lint_nl(linter);
 }
 
-ANN static void lint_stmt_if(Linter* linter, Stmt_If stmt) {
+ANN static void lint_stmt_if(Linter* linter, CStmt_If stmt) {
   lint_print(linter, "if(");
   lint_exp(linter, stmt->cond);
   lint_print(linter, ")");
@@ -441,7 +463,7 @@ ANN static void lint_stmt_if(Linter* linter, Stmt_If stmt) {
   }
 }
 
-ANN void lint_stmt_enum(Linter* linter, Stmt_Enum stmt) {
+ANN void lint_stmt_enum(Linter* linter, CStmt_Enum stmt) {
   ID_List list = stmt->list;
   lint_print(linter, "enum {");
   lint_nl(linter);
@@ -462,7 +484,7 @@ ANN void lint_stmt_enum(Linter* linter, Stmt_Enum stmt) {
   lint_nl(linter);
 }
 
-ANN void lint_stmt_fptr(Linter* linter, Stmt_Fptr ptr) {
+ANN void lint_stmt_fptr(Linter* linter, CStmt_Fptr ptr) {
   Arg_List list = ptr->args;
   lint_print(linter, "typedef ");
   lint_type_decl(linter, ptr->td);
@@ -482,7 +504,7 @@ ANN void lint_stmt_fptr(Linter* linter, Stmt_Fptr ptr) {
   lint_nl(linter);
 }
 
-ANN void lint_stmt_type(Linter* linter, Stmt_Type ptr) {
+ANN void lint_stmt_type(Linter* linter, CStmt_Type ptr) {
   lint_print(linter, "typedef ");
   lint_type_decl(linter, ptr->td);
   lint_print(linter, " ");
@@ -491,7 +513,7 @@ ANN void lint_stmt_type(Linter* linter, Stmt_Type ptr) {
   lint_nl(linter);
 }
 
-ANN void lint_stmt_union(Linter* linter, Stmt_Union stmt) {
+ANN void lint_stmt_union(Linter* linter, CStmt_Union stmt) {
   Decl_List l = stmt->l;
   if(GET_FLAG(stmt, private))
     lint_print(linter, "private ");
@@ -517,7 +539,7 @@ ANN void lint_stmt_union(Linter* linter, Stmt_Union stmt) {
   lint_nl(linter);
 }
 
-ANN void lint_stmt_goto(Linter* linter, Stmt_Jump stmt) {
+ANN void lint_stmt_goto(Linter* linter, CStmt_Jump stmt) {
   if(stmt->is_label)
     lint_print(linter, "%s:", s_name(stmt->name));
   else
@@ -525,17 +547,17 @@ ANN void lint_stmt_goto(Linter* linter, Stmt_Jump stmt) {
   lint_nl(linter);
 }
 
-ANN void lint_stmt_continue(Linter* linter, Stmt stmt __attribute__((unused))) {
+ANN void lint_stmt_continue(Linter* linter, CStmt stmt __attribute__((unused))) {
   lint_print(linter, "continue;");
   lint_nl(linter);
 }
 
-ANN void lint_stmt_break(Linter* linter, Stmt stmt __attribute__((unused))) {
+ANN void lint_stmt_break(Linter* linter, CStmt stmt __attribute__((unused))) {
   lint_print(linter, "break;");
   lint_nl(linter);
 }
 
-ANN void lint_stmt_pp(Linter* linter, Stmt_PP stmt) {
+ANN void lint_stmt_pp(Linter* linter, CStmt_PP stmt) {
   if(stmt->type == ae_pp_comment)
     lint_print(linter, "// ");
   else if(stmt->type == ae_pp_include)
@@ -557,7 +579,7 @@ ANN void lint_stmt_pp(Linter* linter, Stmt_PP stmt) {
   lint_nl(linter);
 }
 
-ANN static void lint_stmt(Linter* linter, Stmt stmt) {
+ANN static void lint_stmt(Linter* linter, CStmt stmt) {
   if(stmt->stmt_type == ae_stmt_exp && !stmt->d.stmt_exp.val)
     return;
   lint_indent(linter);
@@ -625,12 +647,12 @@ ANN static void lint_stmt(Linter* linter, Stmt stmt) {
   }
 }
 
-ANN static void lint_stmt_list(Linter* linter, Stmt_List list) {
+ANN static void lint_stmt_list(Linter* linter, CStmt_List list) {
   do lint_stmt(linter, list->stmt);
   while((list = list->next));
 }
 
-ANN static void lint_func_def(Linter* linter, Func_Def f) {
+ANN static void lint_func_def(Linter* linter, CFunc_Def f) {
   Arg_List list = f->arg_list;
   lint_indent(linter);
   lint_print(linter, "%s", GET_FLAG(f, variadic) ?
@@ -652,10 +674,9 @@ ANN static void lint_func_def(Linter* linter, Func_Def f) {
   linter->skip++;
   lint_stmt_indent(linter, f->d.code);
   lint_nl(linter);
-  f->flag &= ~ae_flag_template;
 }
 
-ANN static void lint_section(Linter* linter, Section* section) {
+ANN static void lint_section(Linter* linter, const Section* section) {
   ae_section_t t = section->section_type;
   if(t == ae_section_stmt)
     lint_stmt_list(linter, section->d.stmt_list);
@@ -665,7 +686,7 @@ ANN static void lint_section(Linter* linter, Section* section) {
     lint_class_def(linter, section->d.class_def);
 }
 
-ANN static void lint_class_def(Linter* linter, Class_Def class_def) {
+ANN static void lint_class_def(Linter* linter, CClass_Def class_def) {
   Class_Body body = class_def->body;
   lint_indent(linter);
   if(class_def->tmpl) {
@@ -691,34 +712,554 @@ ANN static void lint_class_def(Linter* linter, Class_Def class_def) {
   lint_nl(linter);
 }
 
-ANN void lint_ast(Linter* linter, Ast ast) {
+ANN void lint_ast(Linter* linter, CAst ast) {
   do lint_section(linter, ast->section);
   while((ast = ast->next));
 }
 
+ANN static void lint_part(Part* part) {
+  part->linter.file = open_memstream(&part->buf, &part->len);
+  lint_section(&part->linter, part->section);
+  fclose(part->linter.file);
+}
+
+ANN static void* lint_worker(void* data) {
+  Work* work = (Work*)data;
+  m_uint i;
+  while((i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED)) < work->n)
+    lint_part(&work->part[i]);
+  return NULL;
+}
+
+ANN static m_bool lint_clean(const Linter* linter) {
+  return !linter->indent && !linter->skip && !linter->nonl && !linter->comment;
+}
+
+// where the last line of a part starts, from the end of that part:
+// zero unless the part did not end with a newline
+ANN static m_uint lint_column(const Part* part) {
+  return part->len - part->linter.pos;
+}
+
+// a section that did not leave the linter in its initial state, or on a
+// line of its own, makes the next one depend on it: redo that one with the
+// carried state, its first line starting back in the previous section
+ANN static void lint_carry(Part* part, const Part* prev) {
+  free(part->buf);
+  vector_clear(part->linter.warn);
+  part->linter.line = 0;
+  part->linter.pos = -lint_column(prev);
+  part->linter.indent = prev->linter.indent;
+  part->linter.skip = prev->linter.skip;
+  part->linter.nonl = prev->linter.nonl;
+  part->linter.comment = prev->linter.comment;
+  lint_part(part);
+}
+
+ANN void lint_ast_parallel(Linter* linter, CAst ast, m_uint jobs) {
+  const m_int base = ftell(linter->file);
+  m_uint n = 0, line = linter->line;
+  m_int pos = base;
+  for(CAst a = ast; a; a = a->next)
+    n++;
+  Work work = { calloc(n, sizeof(Part)), n, 0 };
+  for(m_uint i = 0; i < n; i++, ast = ast->next) {
+    Linter l = { linter->name, NULL, 0, 0, 0, 0, 0, 0, new_vector() };
+    memcpy(&work.part[i].linter, &l, sizeof(Linter));
+    work.part[i].section = ast->section;
+  }
+  work.part[0].linter.pos = (m_uint)(linter->pos - base);
+  if(jobs > n)
+    jobs = n;
+  pthread_t thread[jobs];
+  m_uint started = 0;
+  while(started < jobs &&
+      !pthread_create(&thread[started], NULL, lint_worker, &work))
+    started++;
+  // a thread that did not start leaves the sections to the caller
+  if(started < jobs)
+    lint_worker(&work);
+  for(m_uint i = 0; i < started; i++)
+    pthread_join(thread[i], NULL);
+  for(m_uint i = 0; i < n; i++) {
+    Part* part = &work.part[i];
+    if(i && (!lint_clean(&work.part[i - 1].linter) ||
+        lint_column(&work.part[i - 1])))
+      lint_carry(part, &work.part[i - 1]);
+    fwrite(part->buf, 1, part->len, linter->file);
+    for(m_uint j = 0; base != -1 && j < vector_size(part->linter.warn); j += 3) {
+      const m_uint l = line + vector_at(part->linter.warn, j),
+        p = pos + vector_at(part->linter.warn, j + 1),
+        prev = pos + vector_at(part->linter.warn, j + 2);
+      if(linter->warn) {
+        vector_add(linter->warn, (vtype)l);
+        vector_add(linter->warn, (vtype)p);
+        vector_add(linter->warn, (vtype)prev);
+      } else
+        lint_long_line(linter->name, l, p, prev);
+    }
+    line += part->linter.line;
+    pos += part->len;
+    free(part->buf);
+    free_vector(part->linter.warn);
+  }
+  free(work.part);
+}
+
+#ifndef GWTOOLS
+// warnings are kept relative to the start of the file's output
+ANN static void lint_emit(const m_str name, const char* buf, const size_t len,
+    const char* warn, const m_uint n) {
+  const m_int base = ftell(stdout);
+  fwrite(buf, 1, len, stdout);
+  for(m_uint i = 0; base != -1 && i < n; i += 3) {
+    m_uint w[3];
+    memcpy(w, warn + i * sizeof(m_uint), sizeof(w));
+    lint_long_line(name, w[0], base + w[1], base + w[2]);
+  }
+}
+
+// an unchanged file is printed from the cache without being parsed
+ANN static void lint_cached(Cache* cache, Scanner* scan, const m_str name,
+    char* src, const size_t size, const m_uint jobs) {
+  CacheEntry entry;
+  StatClock clock;
+  Ast ast = NULL;
+  const uint64_t key = cache_key(scan->lint ? "gwpp -l" : "gwpp", name, src, size);
+  if(cache_get(cache, key, &entry)) {
+    stats_start(&clock);
+    lint_emit(name, entry.sec[0], entry.len[0], entry.sec[1],
+        entry.len[1] / sizeof(m_uint));
+    stats_stop(&clock, phase_emit);
+    cache_done(&entry);
+    return;
+  }
+  FILE* f = fmemopen(src, size, "r");
+  stats_start(&clock);
+  arena_begin();
+  if(f)
+    ast = parse(scan, name, f);
+  arena_end();
+  stats_stop(&clock, phase_parse);
+  if(ast) {
+    Linter linter = { name, NULL, 1, 0, 0, 0, 0, 0, new_vector() };
+    char* buf;
+    size_t len;
+    ast_stats(ast);
+    linter.file = open_memstream(&buf, &len);
+    stats_start(&clock);
+    if(jobs > 1 && ast->next)
+      lint_ast_parallel(&linter, ast, jobs);
+    else
+      lint_ast(&linter, ast);
+    fclose(linter.file);
+    stats_stop(&clock, phase_walk);
+    stats_start(&clock);
+    release_ast(ast);
+    stats_stop(&clock, phase_free);
+    const m_uint n = vector_size(linter.warn);
+    m_uint warn[n + 1];
+    for(m_uint i = 0; i < n; i++)
+      warn[i] = vector_at(linter.warn, i);
+    const char* sec[CACHE_SECTIONS] = { buf, (const char*)warn, NULL };
+    const size_t sz[CACHE_SECTIONS] = { len, n * sizeof(m_uint), 0 };
+    stats_start(&clock);
+    lint_emit(name, buf, len, (const char*)warn, n);
+    stats_stop(&clock, phase_emit);
+    cache_put(cache, key, sec, sz);
+    free_vector(linter.warn);
+    free(buf);
+  }
+  if(f)
+    fclose(f);
+}
+
+ANN static void lint_file(Scanner* scan, const m_str name, char* src,
+    const size_t size, const m_uint jobs) {
+  Linter linter = { name, stdout, 1, 0, 0, 0, 0, 0, NULL };
+  StatClock clock;
+  Ast ast = NULL;
+  FILE* f = fmemopen(src, size, "r");
+  if(!f)
+    return;
+  stats_start(&clock);
+  arena_begin();
+  ast = parse(scan, name, f);
+  arena_end();
+  stats_stop(&clock, phase_parse);
+  if(ast) {
+    ast_stats(ast);
+    linter.pos = ftell(stdout);
+    stats_start(&clock);
+    if(jobs > 1 && ast->next)
+      lint_ast_parallel(&linter, ast, jobs);
+    else
+      lint_ast(&linter, ast);
+    stats_stop(&clock, phase_walk);
+    stats_start(&clock);
+    release_ast(ast);
+    stats_stop(&clock, phase_free);
+  }
+  fclose(f);
+}
+
+static void lint_files(Scanner* scan, Vector files, Cache* cached,
+    const m_uint jobs) {
+  const m_uint n = vector_size(files);
+  const char** names = malloc(n * sizeof(char*));
+  for(m_uint i = 0; i < n; i++)
+    names[i] = (const char*)vector_at(files, i);
+  Prefetch* p = prefetch_start(names, n);
+  for(m_uint i = 0; i < n; i++) {
+    const m_str name = (m_str)vector_at(files, i);
+    StatClock clock;
+    size_t size;
+    stats_start(&clock);
+    char* src = prefetch_next(p, &size);
+    stats_stop(&clock, phase_open);
+    if(!src)
+      continue;
+    if(cached)
+      lint_cached(cached, scan, name, src, size, jobs);
+    else
+      lint_file(scan, name, src, size, jobs);
+    free(src);
+  }
+  prefetch_stop(p);
+  free(names);
+}
+
+// the shape of a file is what is printed for it, section by section:
+// the layout of the source is gone from it. printing is idempotent when
+// the output, parsed and printed again, has the same shape.
+enum { check_ok, check_parse, check_reparse, check_differ };
+
+typedef struct {
+  m_str    name;
+  m_int    stamp;
+  off_t    size;
+  time_t   mtime;
+  uint64_t hash;
+  uint64_t shape;
+  m_uint   fail;
+  m_uint   section;  // the first that differs, from 1
+  m_uint   line;     // where it starts in the first output
+  m_bool   read;
+} Check;
+
+typedef struct {
+  Check*   check;
+  Scanner* scan;
+  m_uint   size;  // of the scanners
+  m_bool   lint;
+} CheckPool;
+
+// each section's hash and where its output ends, then the whole output
+ANN static char* lint_shape(const m_str name, CAst ast, Vector shape,
+    size_t* len) {
+  Linter linter = { name, NULL, 1, 0, 0, 0, 0, 0, new_vector() };
+  char* buf;
+  linter.file = open_memstream(&buf, len);
+  do {
+    lint_section(&linter, ast->section);
+    vector_add(shape, 0);
+    vector_add(shape, (vtype)ftell(linter.file));
+  } while((ast = ast->next));
+  fclose(linter.file);
+  free_vector(linter.warn);
+  for(m_uint i = 0, start = 0; i < vector_size(shape); i += 2) {
+    const m_uint end = vector_at(shape, i + 1);
+    vector_set(shape, i, (vtype)tag_hash(buf + start, end - start));
+    start = end;
+  }
+  return buf;
+}
+
+// the first section that printed differently, and its line
+ANN static m_uint check_where(Check* c, const char* buf, Vector a, Vector b) {
+  m_uint i = 0;
+  while(i < vector_size(a) && i < vector_size(b) &&
+      vector_at(a, i) == vector_at(b, i))
+    i += 2;
+  const char* end = buf + (i ? vector_at(a, i - 1) : 0);
+  c->section = i / 2 + 1;
+  c->line = 1;
+  for(const char* p = buf; (p = memchr(p, '\n', end - p)); p++)
+    c->line++;
+  return check_differ;
+}
+
+// printed once, then again from that output unless the manifest knows
+// the shape: the shape of a file comes from the same walk that prints it
+ANN static m_uint check_file(Scanner* scan, Check* c, char* src,
+    const size_t size) {
+  StatClock clock;
+  size_t len, len2;
+  FILE* f = fmemopen(src, size, "r");
+  Ast ast = NULL;
+  stats_start(&clock);
+  arena_begin();
+  if(f)
+    ast = parse(scan, c->name, f);
+  arena_end();
+  stats_stop(&clock, phase_parse);
+  if(!ast) {
+    if(f)
+      fclose(f);
+    return check_parse;
+  }
+  ast_stats(ast);
+  Vector first = new_vector();
+  stats_start(&clock);
+  char* buf = lint_shape(c->name, ast, first, &len);
+  stats_stop(&clock, phase_walk);
+  release_ast(ast);
+  fclose(f);
+  const uint64_t shape = tag_hash(buf, len);
+  m_uint ret = check_ok;
+  if(c->stamp == -1 || shape != c->shape) {
+    f = fmemopen(buf, len, "r");
+    stats_start(&clock);
+    arena_begin();
+    ast = f ? parse(scan, c->name, f) : NULL;
+    arena_end();
+    stats_stop(&clock, phase_parse);
+    if(ast) {
+      Vector second = new_vector();
+      stats_start(&clock);
+      char* again = lint_shape(c->name, ast, second, &len2);
+      stats_stop(&clock, phase_walk);
+      if(tag_hash(again, len2) != shape)
+        ret = check_where(c, buf, first, second);
+      release_ast(ast);
+      free_vector(second);
+      free(again);
+    } else
+      ret = check_reparse;
+    if(f)
+      fclose(f);
+  }
+  c->shape = shape;
+  free_vector(first);
+  free(buf);
+  return ret;
+}
+
+static void check_init(void* data, const m_uint worker __attribute__((unused))) {
+  CheckPool* cp = (CheckPool*)data;
+  cp->scan = new_scanner(cp->size);
+  cp->scan->lint = cp->lint;
+}
+
+static void check_job(void* data, const m_uint worker __attribute__((unused)),
+    const m_uint i) {
+  CheckPool* cp = (CheckPool*)data;
+  Check* c = &cp->check[i];
+  StatClock clock;
+  size_t size;
+  stats_start(&clock);
+  char* src = prefetch_read(c->name, &size);
+  stats_stop(&clock, phase_open);
+  if(!src)
+    return;
+  const uint64_t hash = tag_hash(src, size);
+  c->read = 1;
+  if(c->stamp == -1 || c->hash != hash)
+    c->fail = check_file(cp->scan, c, src, size);
+  c->hash = hash;
+  free(src);
+}
+
+static void check_end(void* data, const m_uint worker) {
+  CheckPool* cp = (CheckPool*)data;
+  free_scanner(cp->scan);
+  if(worker)
+    stats_worker();
+}
+
+// --idempotent: the files are checked on jobs worker processes. with a
+// manifest, the files and shapes found idempotent are not checked again.
+static int lint_check(Vector files, const m_str manifest,
+    const m_uint size, const m_bool lint, const m_uint jobs) {
+  static const char* fail[] = { NULL, "does not parse",
+    "does not parse once printed", "prints differently once printed" };
+  Manifest m = { NULL, 0, 0, 0 };
+  const size_t bytes = vector_size(files) * sizeof(Check);
+  Check* check = jobs > 1 ? pool_shared(bytes) : NULL;
+  const m_bool shared = check != NULL;
+  if(!shared)
+    check = malloc(bytes);
+  CheckPool cp = { check, NULL, size, lint };
+  Pool pool = { check_init, check_job, check_end, &cp };
+  m_uint n = 0;
+  int ret = 0;
+  if(manifest)
+    manifest_load(&m, manifest);
+  for(m_uint i = 0; i < vector_size(files); i++) {
+    const m_str name = (m_str)vector_at(files, i);
+    struct stat st;
+    if(stat(name, &st)) {
+      perror(name);
+      ret = 2;
+      continue;
+    }
+    Stamp* stamp = manifest_find(&m, name);
+    if(stamp && stamp->seen)
+      continue;
+    if(stamp) {
+      stamp->seen = 1;
+      if(stamp->mtime == st.st_mtime && stamp->size == st.st_size)
+        continue;
+    }
+    Check c = { name, stamp ? stamp - m.stamp : -1, st.st_size, st.st_mtime,
+      stamp ? stamp->hash : 0, stamp ? stamp->shape : 0, check_ok, 0, 0, 0 };
+    check[n++] = c;
+  }
+  m_uint order[n];
+  for(m_uint i = 0; i < n; i++)
+    order[i] = i;
+  // without shared memory the checks are all run here, as worker 0
+  if(!pool_run(&pool, !shared ? 1 : jobs > n ? n : jobs, order, n)) {
+    fprintf(stderr, "a worker failed: its files were not checked\n");
+    if(shared)
+      pool_unshare(check, bytes);
+    else
+      free(check);
+    manifest_release(&m);
+    return 2;
+  }
+  for(m_uint i = 0; i < n; i++) {
+    const Check* c = &check[i];
+    if(!c->read || c->fail) {
+      if(c->stamp != -1)
+        m.stamp[c->stamp].seen = 0;
+      if(c->fail == check_differ)
+        fprintf(stderr, "%s: %s, from section %lu at line %lu\n", c->name,
+            fail[c->fail], (unsigned long)c->section, (unsigned long)c->line);
+      else if(c->fail)
+        fprintf(stderr, "%s: %s\n", c->name, fail[c->fail]);
+      if(!ret)
+        ret = 1;
+      continue;
+    }
+    Stamp* stamp = c->stamp != -1 ? &m.stamp[c->stamp] : manifest_add(&m, c->name);
+    stamp->mtime = c->mtime;
+    stamp->size = c->size;
+    stamp->hash = c->hash;
+    stamp->shape = c->shape;
+  }
+  if(shared)
+    pool_unshare(check, bytes);
+  else
+    free(check);
+  if(manifest && !manifest_write(&m, manifest)) {
+    perror(manifest);
+    ret = 2;
+  }
+  manifest_release(&m);
+  return ret;
+}
+
+static void lint_add(void* data, const char* name) {
+  vector_add((Vector)data, (vtype)strdup(name));
+}
+
 int main(int argc, char** argv) {
   argc--; argv++;
-  Scanner* scan = new_scanner(127); // magic number
+  m_uint jobs = 1;
+  m_bool cache_stats = 0;
+  size_t cache_size = CACHE_SIZE;
+  Cache cache;
+  Cache* cached = NULL;
+  m_str cache_dir = NULL;
+  m_bool lint = 0, idempotent = 0;
+  m_str manifest = NULL;
+  int ret = 0;
+  Vector files = new_vector();
   while(argc--) {
-    Linter linter = { *argv, NULL, 1, 0, 0, 0, 0, 0 };
     if(!strcmp(*argv, "-l")) {
-      scan->lint = 1;
+      lint = 1;
+      ++argv;
+      continue;
+    }
+    if(!strcmp(*argv, "-j") && argc) {
+      jobs = strtoul(*++argv, NULL, 10);
       ++argv;
+      argc--;
       continue;
     }
-    Ast ast;
-    FILE* f = fopen(*argv, "r");
-    if(!f)
+    if(!strcmp(*argv, "--files-from") && argc) {
+      if(!files_from(*++argv, lint_add, files))
+        ret = 2;
+      ++argv;
+      argc--;
       continue;
-    if(!(ast = parse(scan, *argv++, f)))
-      goto close;
-    linter.file = stdout;
-    lint_ast(&linter, ast);
-    free_ast(ast);
-close:
-    fclose(f);
+    }
+    if(!strcmp(*argv, "--cache") && argc) {
+      cache_dir = *++argv;
+      ++argv;
+      argc--;
+      continue;
+    }
+    if(!strcmp(*argv, "--cache-size") && argc) {
+      cache_size = strtoul(*++argv, NULL, 10) << 20;
+      ++argv;
+      argc--;
+      continue;
+    }
+    if(!strcmp(*argv, "--cache-stats")) {
+      cache_stats = 1;
+      ++argv;
+      continue;
+    }
+    if(!strcmp(*argv, "--arena")) {
+      arena_init();
+      ++argv;
+      continue;
+    }
+    if(!strcmp(*argv, "--idempotent")) {
+      idempotent = 1;
+      ++argv;
+      continue;
+    }
+    if(!strcmp(*argv, "--manifest") && argc) {
+      manifest = *++argv;
+      ++argv;
+      argc--;
+      continue;
+    }
+    if(!strcmp(*argv, "--stats")) {
+      stats_init("gwpp");
+      ast_stats_init();
+      arena_stats_init();
+      ++argv;
+      continue;
+    }
+    vector_add(files, (vtype)strdup(*argv++));
+  }
+  const m_uint size = scan_size(scan_bytes(files));
+  scan_stats_init(size);
+  // the checks make a scanner in each worker, and print nothing to cache
+  if(idempotent) {
+    const int check = lint_check(files, manifest, size, lint, jobs);
+    if(check > ret)
+      ret = check;
+  } else {
+    Scanner* scan = new_scanner(size);
+    scan->lint = lint;
+    if(cache_dir && cache_open(&cache, cache_dir, cache_size))
+      cached = &cache;
+    lint_files(scan, files, cached, jobs);
+    if(cached)
+      cache_close(cached, cache_stats);
+    free_scanner(scan);
   }
-  free_scanner(scan);
+  const m_uint n = vector_size(files);
+  for(m_uint i = 0; i < n; i++)
+    free((m_str)vector_at(files, i));
+  free_vector(files);
   free_symbols();
-  return 0;
+  stats_report(stderr);
+  return ret;
 }
+#endif
@@ -0,0 +1,18 @@
+#ifndef GWPP_H
+#define GWPP_H
+
+typedef struct {
+  const m_str name;
+  FILE*  file;
+  m_uint line, pos;
+  m_uint indent;
+  m_bool skip;
+  m_bool nonl;
+  m_bool comment;
+  Vector warn;
+} Linter;
+
+ANN void lint_ast(Linter*, CAst);
+// sections are printed on jobs threads, then stitched in order
+ANN void lint_ast_parallel(Linter*, CAst, m_uint);
+#endif
@@ -1,166 +1,433 @@
 #include <stdio.h>
-#include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "defs.h"
 #include "map.h"
 #include "absyn.h"
 #include "hash.h"
 #include "scanner.h"
+#include "astview.h"
+#include "tagfile.h"
+#include "pool.h"
+#include "tagindex.h"
+#include "tagref.h"
+#include "tagd.h"
+#include "cache.h"
+#include "tagdeps.h"
+#include "stats.h"
+#include "prefetch.h"
+#include "arena.h"
+#include "scan.h"
+#include "tagskim.h"
+#include "gwtag.h"
 
 #define TABLEN 2
+#define SEARCH_MAX 50
 
 extern m_str op2str(Operator);
 
 typedef struct {
-  const m_str  filename;
-  Vector class_stack;
-  FILE*  file;
-} Tagger;
+  TagSort* tag;
+  TagSort* ref;
+  TagSort* dep;
+  Cache*   cache;
+  m_uint   size;   // of the scanners
+  m_bool   locals;
+} TagOut;
 
-static void tag_exp(Tagger* tagger, Exp exp);
-static void tag_type_decl(Tagger* tagger, Type_Decl* type);
-static void tag_stmt(Tagger* tagger, Stmt stmt);
-static void tag_stmt_list(Tagger* tagger, Stmt_List list);
-static void tag_class_def(Tagger* tagger, Class_Def class_def);
+typedef struct {
+  m_str    name;
+  m_int    stamp;
+  off_t    size;
+  time_t   mtime;
+  uint64_t hash;
+  uint64_t shape;
+  m_bool   read;
+  m_bool   changed;
+} Job;
+
+typedef struct {
+  Job*     job;
+  FILE**   run;
+  FILE**   ref;
+  FILE**   dep;
+  Scanner* scan;
+  TagOut   out;
+} TagPool;
+
+typedef struct {
+  Scanner* scan;
+  m_bool   locals;
+} TagDaemon;
+
+static void tag_exp(Tagger* tagger, CExp exp);
+static void tag_stmt(Tagger* tagger, CStmt stmt);
+static void tag_stmt_list(Tagger* tagger, CStmt_List list);
+static void tag_class_def(Tagger* tagger, CClass_Def class_def);
 
-static void tag_print(Tagger* tagger, const char* fmt, ...) {
-  va_list arg;
-  va_start(arg, fmt);
-  vfprintf(tagger->file, fmt, arg);
-  va_end(arg);
+// a tag line is built here and written out when full or done. field
+// values are escaped as the extended format wants, or as json strings
+// when there is an uri; nothing is a format.
+#define TAG_LINE 512
+typedef struct {
+  FILE*       file;
+  const char* uri;
+  int         pos;
+  size_t      len;
+  char        buf[TAG_LINE];
+} TagLine;
+
+static void line_flush(TagLine* line) {
+  fwrite(line->buf, 1, line->len, line->file);
+  line->len = 0;
 }
 
-static void tag(Tagger* tagger, const m_str name) {
-  tag_print(tagger, "%s\t%s\t", name, tagger->filename);
+static void line_char(TagLine* line, const char c) {
+  if(line->len == TAG_LINE)
+    line_flush(line);
+  line->buf[line->len++] = c;
 }
 
-static void tag_id_list(Tagger* tagger, ID_List list) {
-  m_bool next = list->next ? 1 : 0;
-  if(next)
-    tag_print(tagger, "<");
-  while(list) {
-    tag_print(tagger, s_name(list->xid));
-    list = list->next;
-    if(list)
-      tag_print(tagger, ".");
-  }
-  if(next)
-    tag_print(tagger, ">");
-}
-
-static void tag_array(Tagger* tagger, Array_Sub array) {
-  m_uint i;
-  Exp exp = array->exp;
-  for(i = 0; i < array->depth; i++) {
-    Exp tmp = exp ? exp->next : NULL;
-    if(exp)
-      exp->next = NULL;
-    tag_print(tagger, "[");
-    if(exp)
-     tag_exp(tagger, exp);
-    tag_print(tagger, "]");
-    if(exp) {
-      exp->next = tmp;
-      exp = tmp;
+static void line_raw(TagLine* line, const char* str) {
+  while(*str)
+    line_char(line, *str++);
+}
+
+static void line_json(TagLine* line, const char* str) {
+  static const char hex[] = "0123456789abcdef";
+  for(; *str; str++) {
+    const unsigned char c = *str;
+    if(c == '"' || c == '\\') {
+      line_char(line, '\\');
+      line_char(line, c);
+    } else if(c < 0x20) {
+      line_raw(line, "\\u00");
+      line_char(line, hex[c >> 4]);
+      line_char(line, hex[c & 15]);
+    } else
+      line_char(line, c);
+  }
+}
+
+static void line_str(TagLine* line, const char* str) {
+  if(line->uri) {
+    line_json(line, str);
+    return;
+  }
+  for(; *str; str++) {
+    const char* esc = *str == '\\' ? "\\\\" : *str == '\t' ? "\\t" :
+      *str == '\n' ? "\\n" : *str == '\r' ? "\\r" : NULL;
+    if(esc)
+      line_raw(line, esc);
+    else
+      line_char(line, *str);
+  }
+}
+
+static void line_int(TagLine* line, const int i) {
+  char num[16];
+  int n = 0;
+  unsigned u = i < 0 ? 0 : i;
+  do num[n++] = '0' + u % 10;
+  while((u /= 10));
+  while(n)
+    line_char(line, num[--n]);
+}
+
+static void line_id_list(TagLine* line, ID_List list, const char sep) {
+  for(; list; list = list->next) {
+    line_str(line, s_name(list->xid));
+    if(list->next)
+      line_char(line, sep);
+  }
+}
+
+static void line_type(TagLine* line, const Type_Decl* td) {
+  if(td->xid->ref) {
+    line_raw(line, "typeof ");
+    line_id_list(line, td->xid->ref, '.');
+  } else
+    line_id_list(line, td->xid, '.');
+  if(td->types) {
+    line_raw(line, "<~");
+    for(Type_List list = td->types; list; list = list->next) {
+      line_type(line, list->td);
+      if(list->next)
+        line_char(line, ',');
     }
+    line_raw(line, "~>");
   }
+  if(GET_FLAG(td, ref))
+    line_char(line, '@');
+  if(td->array)
+    for(m_uint i = 0; i < td->array->depth; i++)
+      line_raw(line, "[]");
 }
 
-static void tag_type_list(Tagger* tagger, Type_List list) {
-  tag_print(tagger, "<{");
-  while(list) {
-    tag_type_decl(tagger, list->td);
-    list = list->next;
-    if(list)
-      tag_print(tagger, ", ");
+// every enclosing class
+static void line_scope(TagLine* line, const Vector class_stack) {
+  const m_uint n = vector_size(class_stack);
+  for(m_uint i = 0; i < n; i++) {
+    const Class_Def owner = (Class_Def)vector_at(class_stack, i);
+    line_str(line, s_name(owner->name->xid));
+    if(i + 1 < n)
+      line_char(line, '.');
   }
-  tag_print(tagger, "}>");
 }
 
-static void tag_type_decl(Tagger* tagger, Type_Decl* type) {
-  if(type->xid->ref) {
-    tag_print(tagger, "typeof ");
-    tag_id_list(tagger, type->xid->ref ? type->xid->ref : type->xid);
-  } else {
-    if(type->types)
-      tag_type_list(tagger, type->types);
-    tag_id_list(tagger, type->xid);
+// the SymbolKind of the language server protocol
+enum {
+  LSP_CLASS = 5, LSP_METHOD = 6, LSP_FIELD = 8, LSP_ENUM = 10,
+  LSP_FUNCTION = 12, LSP_VARIABLE = 13, LSP_ENUM_MEMBER = 22,
+  LSP_STRUCT = 23, LSP_TYPE_PARAMETER = 26
+};
+
+// 't' covers enums, typedefs and function pointers:
+// those pass their SymbolKind to tag_open_as
+static int lsp_kind(const Tagger* tagger, const char kind) {
+  const m_bool member = vector_size(tagger->class_stack) && !tagger->func;
+  switch(kind) {
+    case 'c': return LSP_CLASS;
+    case 'f': return member ? LSP_METHOD : LSP_FUNCTION;
+    case 'm': return LSP_FIELD;
+    case 'e': return LSP_ENUM_MEMBER;
+    case 'u': return LSP_STRUCT;
+    default:  return LSP_VARIABLE;
   }
-  if(GET_FLAG(type, ref))
-    tag_print(tagger, "@");
-  if(type->array)
-    tag_array(tagger, type->array);
 }
 
-static void tag_exp_decl(Tagger* tagger, Exp_Decl* decl) {
-  Var_Decl_List list = decl->list;
-  while(list) {
-    tag(tagger, s_name(list->self->xid));
-    tag_print(tagger, "/^");
-    tag_type_decl(tagger, decl->td);
+// a SymbolInformation, up to its location which tag_close writes
+static void tag_open_json(TagLine* line, Tagger* tagger, const m_str name,
+    const int lsp) {
+  line_raw(line, "{\"name\":\"");
+  line_str(line, name);
+  line_raw(line, "\",\"kind\":");
+  line_int(line, lsp);
+  if(vector_size(tagger->class_stack)) {
+    line_raw(line, ",\"containerName\":\"");
+    line_scope(line, tagger->class_stack);
+    line_char(line, '"');
+  }
+}
+
+// name, file, line and kind, then the scope
+static void tag_open_as(TagLine* line, Tagger* tagger, const m_str name,
+    const int pos, const char* kind, const int lsp) {
+  line->file = tagger->file;
+  line->uri = tagger->uri;
+  line->pos = pos;
+  line->len = 0;
+  if(line->uri) {
+    tag_open_json(line, tagger, name, lsp);
+    return;
+  }
+  line_raw(line, name);
+  line_char(line, '\t');
+  line_raw(line, tagger->filename);
+  line_char(line, '\t');
+  line_int(line, pos);
+  line_raw(line, ";\"\t");
+  line_raw(line, kind);
+  if(!vector_size(tagger->class_stack))
+    return;
+  line_raw(line, "\tclass:");
+  line_scope(line, tagger->class_stack);
+}
+
+static void tag_signature(TagLine* line, Arg_List args) {
+  if(line->uri)
+    return;
+  line_raw(line, "\tsignature:(");
+  for(; args; args = args->next) {
+    line_type(line, args->td);
+    if(args->var_decl && args->var_decl->xid) {
+      line_char(line, ' ');
+      line_str(line, s_name(args->var_decl->xid));
+    }
+    if(args->next)
+      line_raw(line, ", ");
+  }
+  line_char(line, ')');
+}
+
+static void tag_template(TagLine* line, ID_List list) {
+  if(!list || line->uri)
+    return;
+  line_raw(line, "\ttemplate:");
+  line_id_list(line, list, ',');
+}
+
+// the position is a line: the range is its start, counted from 0
+static void tag_close_json(TagLine* line) {
+  const int pos = line->pos > 0 ? line->pos - 1 : 0;
+  line_raw(line, ",\"location\":{\"uri\":\"");
+  line_raw(line, line->uri);
+  line_raw(line, "\",\"range\":{\"start\":{\"line\":");
+  line_int(line, pos);
+  line_raw(line, ",\"character\":0},\"end\":{\"line\":");
+  line_int(line, pos);
+  line_raw(line, ",\"character\":0}}}}\n");
+  line_flush(line);
+}
+
+static void tag_close(TagLine* line, const ae_flag flag) {
+  if(line->uri) {
+    tag_close_json(line);
+    return;
+  }
+  if(flag & (ae_flag_private | ae_flag_static)) {
+    line_raw(line, "\taccess:");
+    if(flag & ae_flag_private)
+      line_raw(line, flag & ae_flag_static ? "private,static" : "private");
+    else
+      line_raw(line, "static");
+  }
+  line_char(line, '\n');
+  line_flush(line);
+}
+
+static void tag_open(TagLine* line, Tagger* tagger, const m_str name,
+    const int pos, const char* kind) {
+  tag_open_as(line, tagger, name, pos, kind, lsp_kind(tagger, *kind));
+}
+
+static void tag_as(Tagger* tagger, const m_str name, const int pos,
+    const char* kind, const int lsp, const ae_flag flag) {
+  TagLine line;
+  tag_open_as(&line, tagger, name, pos, kind, lsp);
+  tag_close(&line, flag);
+}
+
+static void tag(Tagger* tagger, const m_str name, const int pos,
+    const char* kind, const ae_flag flag) {
+  tag_as(tagger, name, pos, kind, lsp_kind(tagger, *kind), flag);
+}
+
+static void tag_ref(Tagger* tagger, const Symbol xid, const int pos, const int kind) {
+  if(tagger->refs)
+    fprintf(tagger->refs, "%s\t%s\t%08x\t%c\n", s_name(xid),
+        tagger->filename, pos, REF_KINDS[kind]);
+}
+
+// a type is used where it is declared, cast to or made with new:
+// every name of its path, what it is the typeof and its type arguments
+static void tag_type_ref(Tagger* tagger, const Type_Decl* td, const int pos) {
+  for(ID_List xid = td->xid->ref ? td->xid->ref : td->xid; xid; xid = xid->next)
+    tag_ref(tagger, xid->xid, pos, ref_use);
+  for(Type_List types = td->types; types; types = types->next)
+    tag_type_ref(tagger, types->td, pos);
+  if(td->array)
+    tag_exp(tagger, td->array->exp);
+}
+
+// the uses are there whether or not the variables are tagged
+static void tag_exp_decl(Tagger* tagger, const Exp_Decl* decl, const int pos) {
+  tag_type_ref(tagger, decl->td, pos);
+  for(Var_Decl_List list = decl->list; list; list = list->next) {
     if(list->self->array)
-      tag_array(tagger, list->self->array);
-    tag_print(tagger, "$/;\"\t%s\n", vector_front(tagger->class_stack) ?
-        "m" : "v");
-    list = list->next;
+      tag_exp(tagger, list->self->array->exp);
+    if(!tagger->func || tagger->locals)
+      tag(tagger, s_name(list->self->xid), list->self->pos, tagger->func ? "l" :
+          vector_front(tagger->class_stack) ? "m" : "v", decl->td->flag);
   }
 }
 
-static void tag_exp_unary(Tagger* tagger __attribute__((unused)), Exp_Unary* unary __attribute__((unused))) {
-  return;
+static void tag_exp_unary(Tagger* tagger, const Exp_Unary* unary, const int pos) {
+  if(unary->op == op_new)
+    tag_type_ref(tagger, unary->td, pos);
+  else if(unary->op == op_spork && unary->code)
+    tag_stmt(tagger, unary->code);
+  else
+    tag_exp(tagger, unary->exp);
 }
 
-static void tag_exp_binary(Tagger* tagger, Exp_Binary* binary) {
+static void tag_exp_binary(Tagger* tagger, const Exp_Binary* binary) {
   tag_exp(tagger, binary->lhs);
   tag_exp(tagger, binary->rhs);
 }
 
-static void tag_exp_primary(Tagger* tagger __attribute__((unused)), Exp_Primary* exp __attribute__((unused))) {
-  return;
+static void tag_exp_primary(Tagger* tagger, const Exp_Primary* exp, const int pos) {
+  switch(exp->primary_type) {
+    case ae_primary_id:
+      tag_ref(tagger, exp->d.var, pos, ref_use);
+      break;
+    case ae_primary_array:
+      tag_exp(tagger, exp->d.array->exp);
+      break;
+    case ae_primary_hack:
+      tag_exp(tagger, exp->d.exp);
+      break;
+    case ae_primary_complex:
+    case ae_primary_polar:
+    case ae_primary_vec:
+      tag_exp(tagger, exp->d.vec.exp);
+      break;
+    default:
+      break;
+  }
 }
 
-static void tag_exp_array(Tagger* tagger, Exp_Array* array) {
+static void tag_exp_array(Tagger* tagger, const Exp_Array* array) {
   tag_exp(tagger, array->base);
   tag_exp(tagger, array->array->exp);
 }
 
-static void tag_exp_cast(Tagger* tagger, Exp_Cast* cast) {
+static void tag_exp_cast(Tagger* tagger, const Exp_Cast* cast, const int pos) {
   tag_exp(tagger, cast->exp);
+  tag_type_ref(tagger, cast->td, pos);
 }
 
-static void tag_exp_post(Tagger* tagger, Exp_Postfix* post) {
+static void tag_exp_post(Tagger* tagger, const Exp_Postfix* post) {
   tag_exp(tagger, post->exp);
 }
 
-static void tag_exp_call(Tagger* tagger __attribute__((unused)), Exp_Call* exp_call __attribute__((unused))) {
-  return;
+static void tag_exp_call(Tagger* tagger, const Exp_Call* exp_call) {
+  const Exp func = exp_call->func;
+  if(func->exp_type == ae_exp_primary &&
+      func->d.exp_primary.primary_type == ae_primary_id)
+    tag_ref(tagger, func->d.exp_primary.d.var, func->pos, ref_call);
+  else if(func->exp_type == ae_exp_dot) {
+    tag_exp(tagger, func->d.exp_dot.base);
+    tag_ref(tagger, func->d.exp_dot.xid, func->pos, ref_call);
+  } else
+    tag_exp(tagger, func);
+  if(exp_call->tmpl)
+    for(Type_List types = exp_call->tmpl->types; types; types = types->next)
+      tag_type_ref(tagger, types->td, func->pos);
+  tag_exp(tagger, exp_call->args);
 }
 
-static void  tag_exp_dot(Tagger* tagger __attribute__((unused)), Exp_Dot* member __attribute__((unused))) {
-  return;
+static void  tag_exp_dot(Tagger* tagger, const Exp_Dot* member, const int pos) {
+  tag_exp(tagger, member->base);
+  tag_ref(tagger, member->xid, pos, ref_member);
 }
 
-static void  tag_exp_dur(Tagger* tagger __attribute__((unused)), Exp_Dur* member __attribute__((unused))) {
-  return;
+static void  tag_exp_dur(Tagger* tagger, const Exp_Dur* dur) {
+  tag_exp(tagger, dur->base);
+  tag_exp(tagger, dur->unit);
 }
 
-static void tag_exp_if(Tagger* tagger, Exp_If* exp_if) {
+static void tag_exp_if(Tagger* tagger, const Exp_If* exp_if) {
   tag_exp(tagger, exp_if->cond);
   tag_exp(tagger, exp_if->if_exp);
   tag_exp(tagger, exp_if->else_exp);
 }
 
-static void tag_exp(Tagger* tagger,  Exp exp) {
+static void tag_exp(Tagger* tagger,  CExp exp) {
   while(exp) {
     switch(exp->exp_type) {
       case ae_exp_primary:
-        tag_exp_primary(tagger, &exp->d.exp_primary);
+        tag_exp_primary(tagger, &exp->d.exp_primary, exp->pos);
         break;
       case ae_exp_decl:
-        tag_exp_decl(tagger, &exp->d.exp_decl);
+        tag_exp_decl(tagger, &exp->d.exp_decl, exp->pos);
         break;
       case ae_exp_unary:
-        tag_exp_unary(tagger, &exp->d.exp_unary);
+        tag_exp_unary(tagger, &exp->d.exp_unary, exp->pos);
         break;
       case ae_exp_binary:
         tag_exp_binary(tagger, &exp->d.exp_binary);
@@ -169,7 +436,7 @@ static void tag_exp(Tagger* tagger,  Exp exp) {
         tag_exp_post(tagger, &exp->d.exp_post);
         break;
       case ae_exp_cast:
-        tag_exp_cast(tagger, &exp->d.exp_cast);
+        tag_exp_cast(tagger, &exp->d.exp_cast, exp->pos);
         break;
       case ae_exp_call:
         tag_exp_call(tagger, &exp->d.exp_call);
@@ -178,7 +445,7 @@ static void tag_exp(Tagger* tagger,  Exp exp) {
         tag_exp_array(tagger, &exp->d.exp_array);
         break;
       case ae_exp_dot:
-        tag_exp_dot(tagger, &exp->d.exp_dot);
+        tag_exp_dot(tagger, &exp->d.exp_dot, exp->pos);
         break;
       case ae_exp_dur:
         tag_exp_dur(tagger, &exp->d.exp_dur);
@@ -193,121 +460,111 @@ static void tag_exp(Tagger* tagger,  Exp exp) {
   }
 }
 
-static void tag_stmt_code(Tagger* tagger, Stmt_Code stmt) {
+static void tag_stmt_code(Tagger* tagger, CStmt_Code stmt) {
   if(stmt->stmt_list)
     tag_stmt_list(tagger, stmt->stmt_list);
 }
 
-static void tag_stmt_return(Tagger* tagger, Stmt_Exp stmt) {
+static void tag_stmt_return(Tagger* tagger, CStmt_Exp stmt) {
   if(stmt->val)
     tag_exp(tagger, stmt->val);
 }
 
-static void tag_stmt_flow(Tagger* tagger, struct Stmt_Flow_* stmt) {
+static void tag_stmt_flow(Tagger* tagger, CStmt_Flow stmt) {
   tag_exp(tagger, stmt->cond);
   tag_stmt(tagger, stmt->body);
 }
 
-static void tag_stmt_for(Tagger* tagger, Stmt_For stmt) {
+static void tag_stmt_for(Tagger* tagger, CStmt_For stmt) {
   tag_stmt(tagger, stmt->c1);
   tag_stmt(tagger, stmt->c2);
   tag_exp(tagger, stmt->c3);
   tag_stmt(tagger, stmt->body);
 }
 
-static void tag_stmt_auto(Tagger* tagger, Stmt_Auto stmt) {
+static void tag_stmt_auto(Tagger* tagger, CStmt_Auto stmt) {
   // TODO tag id
   tag_exp(tagger, stmt->exp);
   tag_stmt(tagger, stmt->body);
 }
-static void tag_stmt_loop(Tagger* tagger, Stmt_Loop stmt) {
+static void tag_stmt_loop(Tagger* tagger, CStmt_Loop stmt) {
   tag_exp(tagger, stmt->cond);
   tag_stmt(tagger, stmt->body);
 }
 
-static void tag_stmt_switch(Tagger* tagger, Stmt_Switch stmt) {
+static void tag_stmt_switch(Tagger* tagger, CStmt_Switch stmt) {
   tag_exp(tagger, stmt->val);
 }
 
-static void tag_stmt_case(Tagger* tagger, Stmt_Exp stmt) {
+static void tag_stmt_case(Tagger* tagger, CStmt_Exp stmt) {
   tag_exp(tagger, stmt->val);
 }
 
-static void tag_stmt_if(Tagger* tagger, Stmt_If stmt) {
+static void tag_stmt_if(Tagger* tagger, CStmt_If stmt) {
   tag_exp(tagger, stmt->cond);
   tag_stmt(tagger, stmt->if_body);
   if(stmt->else_body)
     tag_stmt(tagger, stmt->else_body);
 }
 
-void tag_stmt_enum(Tagger* tagger, Stmt_Enum stmt) {
+void tag_stmt_enum(Tagger* tagger, CStmt_Enum stmt, const int pos) {
   ID_List list = stmt->list;
-  if(stmt->xid) {
-    tag(tagger, s_name(stmt->xid));
-    tag_print(tagger, "0;\"\tt");
-  }
+  if(stmt->xid)
+    tag_as(tagger, s_name(stmt->xid), pos, "t", LSP_ENUM, stmt->flag);
   while(list) {
-    tag(tagger, s_name(list->xid));
-    tag_print(tagger, "0;\"\te");
+    tag(tagger, s_name(list->xid), list->pos, "e", stmt->flag);
     list = list->next;
   }
 }
 
-void tag_stmt_fptr(Tagger* tagger, Stmt_Fptr ptr) {
-  Arg_List list = ptr->args;
-  tag(tagger, s_name(ptr->xid));
-  tag_print(tagger, "/^");
-  tag_type_decl(tagger, ptr->td);
-  tag_print(tagger, " ");
-  tag_print(tagger, s_name(ptr->xid));
-  tag_print(tagger, "(");
-  while(list) {
-    tag_type_decl(tagger, list->td);
-    tag_print(tagger, " %s", s_name(list->var_decl->xid));
-    list = list->next;
-    if(list)
-      tag_print(tagger, ", ");
-    else if(GET_FLAG(ptr->td, variadic))
-      tag_print(tagger, ", ...");
-  }
-
-  tag_print(tagger, ") {$/;\tt\n");
+void tag_stmt_fptr(Tagger* tagger, CStmt_Fptr ptr, const int pos) {
+  TagLine line;
+  tag_open_as(&line, tagger, s_name(ptr->xid), pos, "t", LSP_FUNCTION);
+  tag_signature(&line, ptr->args);
+  tag_close(&line, ptr->flag);
 }
 
-void tag_stmt_type(Tagger* tagger, Stmt_Type ptr) {
-  tag(tagger, s_name(ptr->xid));
-  tag_print(tagger, "/^");
-  tag_type_decl(tagger, ptr->td);
-  tag_print(tagger, " ");
-  tag_print(tagger, s_name(ptr->xid));
-  tag_print(tagger, ") {$/;\tt\n");
+void tag_stmt_type(Tagger* tagger, CStmt_Type ptr, const int pos) {
+  tag_as(tagger, s_name(ptr->xid), pos, "t", LSP_TYPE_PARAMETER, ptr->flag);
 }
 
-void tag_stmt_union(Tagger* tagger, Stmt_Union stmt) {
+void tag_stmt_union(Tagger* tagger, CStmt_Union stmt, const int pos) {
   Decl_List l = stmt->l;
-  if(stmt->xid) {
-    tag(tagger, s_name(stmt->xid));
-    tag_print(tagger, "0;\"\tu");
-  }
+  if(stmt->xid)
+    tag(tagger, s_name(stmt->xid), pos, "u", stmt->flag);
   while(l) {
     tag_exp(tagger, l->self);
     l = l->next;
   }
 }
 
-void tag_stmt_goto(Tagger* tagger __attribute__((unused)), Stmt_Jump stmt __attribute__((unused))) {
+void tag_stmt_goto(Tagger* tagger __attribute__((unused)), CStmt_Jump stmt __attribute__((unused))) {
   return;
 }
 
-void tag_stmt_continue(Tagger* tagger __attribute__((unused)), Stmt stmt __attribute__((unused))) {
+void tag_stmt_continue(Tagger* tagger __attribute__((unused)), CStmt stmt __attribute__((unused))) {
   return;
 }
 
-void tag_stmt_break(Tagger* tagger __attribute__((unused)), Stmt stmt __attribute__((unused))) {
+void tag_stmt_break(Tagger* tagger __attribute__((unused)), CStmt stmt __attribute__((unused))) {
   return;
 }
 
-static void tag_stmt(Tagger* tagger, Stmt stmt) {
+// an include that is not found next to its includer is kept as written
+static void tag_stmt_pp(Tagger* tagger, CStmt_PP stmt, const int pos) {
+  if(!tagger->deps || stmt->type != ae_pp_include || !stmt->data)
+    return;
+  const char* inc = stmt->data + strspn(stmt->data, " \t\"<");
+  const int len = strcspn(inc, " \t\">\r\n");
+  const char* slash = strrchr(tagger->filename, '/');
+  const int dir = slash && *inc != '/' ? slash - tagger->filename + 1 : 0;
+  char path[dir + len + 1];
+  sprintf(path, "%.*s%.*s", dir, tagger->filename, len, inc);
+  fprintf(tagger->deps, "%s\t%s\t%i\n", access(path, F_OK) ? path + dir : path,
+      tagger->filename, pos);
+}
+
+static void tag_stmt(Tagger* tagger, CStmt stmt) {
   if(stmt->stmt_type == ae_stmt_exp && !stmt->d.stmt_exp.val)
     return;
   switch(stmt->stmt_type) {
@@ -345,7 +602,7 @@ static void tag_stmt(Tagger* tagger, Stmt stmt) {
       tag_stmt_case(tagger, &stmt->d.stmt_exp);
       break;
     case ae_stmt_enum:
-      tag_stmt_enum(tagger, &stmt->d.stmt_enum);
+      tag_stmt_enum(tagger, &stmt->d.stmt_enum, stmt->pos);
       break;
     case ae_stmt_continue:
       tag_stmt_continue(tagger, stmt);
@@ -357,52 +614,43 @@ static void tag_stmt(Tagger* tagger, Stmt stmt) {
       tag_stmt_goto(tagger, &stmt->d.stmt_jump);
       break;
     case ae_stmt_fptr:
-      tag_stmt_fptr(tagger, &stmt->d.stmt_fptr);
+      tag_stmt_fptr(tagger, &stmt->d.stmt_fptr, stmt->pos);
       break;
     case ae_stmt_type:
-      tag_stmt_type(tagger, &stmt->d.stmt_type);
+      tag_stmt_type(tagger, &stmt->d.stmt_type, stmt->pos);
       break;
     case ae_stmt_union:
-      tag_stmt_union(tagger, &stmt->d.stmt_union);
+      tag_stmt_union(tagger, &stmt->d.stmt_union, stmt->pos);
+      break;
+    case ae_stmt_pp:
+      tag_stmt_pp(tagger, &stmt->d.stmt_pp, stmt->pos);
       break;
     default:break;
   }
 }
 
-static void tag_stmt_list(Tagger* tagger, Stmt_List list) {
+static void tag_stmt_list(Tagger* tagger, CStmt_List list) {
   while(list) {
     tag_stmt(tagger, list->stmt);
     list = list->next;
   }
 }
 
-static void tag_func_def(Tagger* tagger, Func_Def f) {
-  Arg_List list = f->arg_list;
-  tag_print(tagger, s_name(f->name));
-  tag_print(tagger, "/^");
-  if(f->tmpl && f->tmpl->base) {
-    tag_print(tagger, "template ");
-    tag_id_list(tagger, f->tmpl->list);
-    tag_print(tagger, " ");
+static void tag_func_def(Tagger* tagger, CFunc_Def f) {
+  TagLine line;
+  tag_open(&line, tagger, s_name(f->name), f->td->xid->pos, "f");
+  tag_signature(&line, f->arg_list);
+  if(f->tmpl)
+    tag_template(&line, f->tmpl->list);
+  tag_close(&line, f->flag | f->td->flag);
+  if((tagger->refs || tagger->locals) && f->d.code) {
+    tagger->func++;
+    tag_stmt(tagger, f->d.code);
+    tagger->func--;
   }
-  tag_type_decl(tagger, f->td);
-  tag_print(tagger, " ");
-  tag_print(tagger, s_name(f->name));
-  tag_print(tagger, "(");
-  while(list) {
-    tag_type_decl(tagger, list->td);
-    tag_print(tagger, " %s", s_name(list->var_decl->xid));
-    list = list->next;
-    if(list)
-      tag_print(tagger, ", ");
-  }
-  if(GET_FLAG(f, variadic))
-    tag_print(tagger, ", ...");
-  tag_print(tagger, ") {$/;\tf\n");
-  f->flag &= ~ae_flag_template;
 }
 
-static void tag_section(Tagger* tagger, Section* section) {
+static void tag_section(Tagger* tagger, const Section* section) {
   ae_section_t t = section->section_type;
   if(t == ae_section_stmt)
     tag_stmt_list(tagger, section->d.stmt_list);
@@ -412,16 +660,13 @@ static void tag_section(Tagger* tagger, Section* section) {
     tag_class_def(tagger, section->d.class_def);
 }
 
-static void tag_class_def(Tagger* tagger, Class_Def class_def) {
+static void tag_class_def(Tagger* tagger, CClass_Def class_def) {
   Class_Body body = class_def->body;
-  tag(tagger, s_name(class_def->name->xid));
-  tag_print(tagger, "/^");
-  if(class_def->tmpl) {
-    tag_print(tagger, "template");
-    tag_id_list(tagger, class_def->tmpl->list.list);
-  }
-// TODO: handle class extend
-  tag_print(tagger, " class %s$/;\"\tc\n", s_name(class_def->name->xid));
+  TagLine line;
+  tag_open(&line, tagger, s_name(class_def->name->xid), class_def->name->pos, "c");
+  if(class_def->tmpl)
+    tag_template(&line, class_def->tmpl->list.list);
+  tag_close(&line, class_def->flag);
   vector_add(tagger->class_stack, (vtype)class_def);
   while(body) {
     tag_section(tagger, body->section);
@@ -430,35 +675,699 @@ static void tag_class_def(Tagger* tagger, Class_Def class_def) {
   vector_pop(tagger->class_stack);
 }
 
-void tag_ast(Tagger* tagger, Ast ast) {
+void tag_ast(Tagger* tagger, CAst ast) {
   while(ast) {
     tag_section(tagger, ast->section);
     ast = ast->next;
   }
 }
 
+// gwtools drives the walk above itself
+#ifndef GWTOOLS
+// without references or locals nothing is wanted from function bodies:
+// they are skimmed over before parsing. src is the caller's to scratch.
+static m_bool tag_src(Scanner* scan, Tagger* tagger, char* src, size_t size) {
+  Ast ast;
+  StatClock clock;
+  FILE* f = fmemopen(src, size, "r");
+  if(!f)
+    return 0;
+  stats_start(&clock);
+  if(!tagger->refs && !tagger->locals)
+    skim_bodies(src, size);
+  arena_begin();
+  ast = parse(scan, tagger->filename, f);
+  arena_end();
+  stats_stop(&clock, phase_parse);
+  if(ast) {
+    ast_stats(ast);
+    tagger->class_stack = new_vector();
+    stats_start(&clock);
+    tag_ast(tagger, ast);
+    stats_stop(&clock, phase_walk);
+    stats_start(&clock);
+    release_ast(ast);
+    free_vector(tagger->class_stack);
+    stats_stop(&clock, phase_free);
+  }
+  fclose(f);
+  return ast ? 1 : 0;
+}
+
+// the shape of a file is what it was tagged as. an edit that leaves it
+// the same, as one to a comment or within a line does, changes nothing:
+// the file's lines already in the tags file are kept.
+static void tag_keep(TagOut* out, Job* job, const char* const sec[],
+    const size_t len[]) {
+  uint64_t shape = 0;
+  for(m_uint i = 0; i < CACHE_SECTIONS; i++)
+    shape = shape * 0x100000001b3 ^ tag_hash(sec[i] ? sec[i] : "", len[i]);
+  job->changed = job->stamp == -1 || shape != job->shape;
+  job->shape = shape;
+  if(!job->changed)
+    return;
+  sort_add(out->tag, sec[0], len[0]);
+  if(out->ref)
+    sort_add(out->ref, sec[1], len[1]);
+  if(out->dep)
+    sort_add(out->dep, sec[2], len[2]);
+}
+
+static m_bool tag_cached(TagOut* out, Job* job, const uint64_t key) {
+  CacheEntry entry;
+  if(!cache_get(out->cache, key, &entry))
+    return 0;
+  tag_keep(out, job, entry.sec, entry.len);
+  cache_done(&entry);
+  return 1;
+}
+
+static void tag_file(Scanner* scan, TagOut* out, Job* job,
+    char* src, size_t size) {
+  static const char* tool[] = { "gwtag", "gwtag -x", "gwtag -d", "gwtag -x -d",
+    "gwtag --locals", "gwtag -x --locals", "gwtag -d --locals", "gwtag -x -d --locals" };
+  char* buf, *ref = NULL, *dep = NULL;
+  size_t len, rlen = 0, dlen = 0;
+  Tagger tagger = { job->name, NULL, NULL, NULL, 0, NULL, out->locals, NULL };
+  const uint64_t key = out->cache ? cache_key(tool[!!out->ref + 2 * !!out->dep +
+      4 * !!out->locals], job->name, src, size) : 0;
+  if(out->cache && tag_cached(out, job, key))
+    return;
+  tagger.file = open_memstream(&buf, &len);
+  if(out->ref)
+    tagger.refs = open_memstream(&ref, &rlen);
+  if(out->dep)
+    tagger.deps = open_memstream(&dep, &dlen);
+  const m_bool ok = tag_src(scan, &tagger, src, size);
+  fclose(tagger.file);
+  if(out->ref)
+    fclose(tagger.refs);
+  if(out->dep)
+    fclose(tagger.deps);
+  if(ok) {
+    const char* sec[CACHE_SECTIONS] = { buf, ref, dep };
+    const size_t n[CACHE_SECTIONS] = { len, rlen, dlen };
+    tag_keep(out, job, sec, n);
+    if(out->cache)
+      cache_put(out->cache, key, sec, n);
+  } else
+    job->changed = 1;
+  free(buf);
+  free(ref);
+  free(dep);
+}
+
+static char* tag_text(void* data, const m_str name, char* src,
+    const size_t size, size_t* len) {
+  char* buf;
+  const TagDaemon* d = (TagDaemon*)data;
+  Tagger tagger = { name, NULL, NULL, NULL, 0, NULL, d->locals, NULL };
+  tagger.file = open_memstream(&buf, len);
+  const m_bool ok = tag_src(d->scan, &tagger, src, size);
+  fclose(tagger.file);
+  if(ok)
+    return buf;
+  free(buf);
+  return NULL;
+}
+
+// file:// and the absolute path, with what is not safe in an uri escaped
+static m_str tag_uri(const m_str name) {
+  static const char hex[] = "0123456789ABCDEF";
+  char* path = realpath(name, NULL);
+  const char* src = path ? path : name;
+  m_str uri = malloc(strlen(src) * 3 + 8), dst = uri + 7;
+  memcpy(uri, "file://", 7);
+  for(; *src; src++) {
+    const unsigned char c = *src;
+    if(isalnum(c) || strchr("/-._~", c))
+      *dst++ = c;
+    else {
+      *dst++ = '%';
+      *dst++ = hex[c >> 4];
+      *dst++ = hex[c & 15];
+    }
+  }
+  *dst = '\0';
+  free(path);
+  return uri;
+}
+
+static int job_cmp(const void* a, const void* b) {
+  const off_t x = ((const Job*)a)->size, y = ((const Job*)b)->size;
+  return (x < y) - (x > y);
+}
+
+// the jobs are read ahead when there is a Prefetch, on demand otherwise
+static void tag_job(Scanner* scan, TagOut* out, Job* job, Prefetch* p) {
+  size_t len;
+  StatClock clock;
+  stats_start(&clock);
+  char* src = p ? prefetch_next(p, &len) : prefetch_read(job->name, &len);
+  stats_stop(&clock, phase_open);
+  if(!src)
+    return;
+  const uint64_t hash = tag_hash(src, len);
+  job->read = 1;
+  if(job->stamp == -1 || job->hash != hash)
+    tag_file(scan, out, job, src, len);
+  job->hash = hash;
+  free(src);
+}
+
+static void pool_init(void* data, const m_uint worker __attribute__((unused))) {
+  TagPool* tp = (TagPool*)data;
+  tp->scan = new_scanner(tp->out.size);
+  tp->out.tag = new_sort();
+  tp->out.ref = tp->ref ? new_sort() : NULL;
+  tp->out.dep = tp->dep ? new_sort() : NULL;
+}
+
+static void pool_job(void* data, const m_uint worker __attribute__((unused)),
+    const m_uint i) {
+  TagPool* tp = (TagPool*)data;
+  tag_job(tp->scan, &tp->out, &tp->job[i], NULL);
+}
+
+static void pool_end(void* data, const m_uint worker) {
+  TagPool* tp = (TagPool*)data;
+  sort_flush(tp->out.tag, tp->run[worker]);
+  fflush(tp->run[worker]);
+  free_sort(tp->out.tag);
+  if(tp->ref) {
+    sort_flush(tp->out.ref, tp->ref[worker]);
+    fflush(tp->ref[worker]);
+    free_sort(tp->out.ref);
+  }
+  if(tp->dep) {
+    sort_flush(tp->out.dep, tp->dep[worker]);
+    fflush(tp->dep[worker]);
+    free_sort(tp->out.dep);
+  }
+  free_scanner(tp->scan);
+  if(worker)
+    stats_worker();
+}
+
+// each worker process sorts its own tags into a run the parent merges
+static m_bool tag_pool(TagOut* out, Job* job, const m_uint n, const m_uint jobs) {
+  FILE* run[jobs], *ref[jobs], *dep[jobs];
+  m_uint order[n];
+  TagPool tp = { job, run, out->ref ? ref : NULL, out->dep ? dep : NULL, NULL,
+    { NULL, NULL, NULL, out->cache, out->size, out->locals } };
+  Pool pool = { pool_init, pool_job, pool_end, &tp };
+  for(m_uint i = 0; i < jobs; i++) {
+    run[i] = tmpfile();
+    if(out->ref)
+      ref[i] = tmpfile();
+    if(out->dep)
+      dep[i] = tmpfile();
+  }
+  for(m_uint i = 0; i < n; i++)
+    order[i] = i;
+  const m_bool ret = pool_run(&pool, jobs, order, n);
+  for(m_uint i = 0; i < jobs; i++) {
+    rewind(run[i]);
+    sort_run(out->tag, run[i]);
+    if(out->ref) {
+      rewind(ref[i]);
+      sort_run(out->ref, ref[i]);
+    }
+    if(out->dep) {
+      rewind(dep[i]);
+      sort_run(out->dep, dep[i]);
+    }
+  }
+  return ret;
+}
+
+static void tag_drop(TagOut* out, const m_str name) {
+  sort_drop(out->tag, name);
+  if(out->dep)
+    sort_drop(out->dep, name);
+}
+
+// the graph is checked for cycles each time it is written
+static m_bool dep_update(TagOut* out, const m_str deps, const m_bool update) {
+  char tmp[strlen(deps) + 5];
+  DepGraph graph;
+  FILE* file;
+  sprintf(tmp, "%s.tmp", deps);
+  if(update && !sort_splice(out->dep, deps))
+    return 0;
+  if(!(file = fopen(tmp, "w")))
+    return 0;
+  sort_flush(out->dep, file);
+  fclose(file);
+  if(rename(tmp, deps))
+    return 0;
+  if(deps_load(&graph, deps))
+    deps_order(&graph, NULL);
+  deps_release(&graph);
+  return 1;
+}
+
+// the old references of unchanged files go back in as one more run
+static m_bool ref_update(TagOut* out, const m_str refs, const m_bool update) {
+  FILE* file = tmpfile();
+  if(!file)
+    return 0;
+  if(update && !ref_dump(refs, file, out->tag)) {
+    fclose(file);
+    return 0;
+  }
+  rewind(file);
+  sort_run(out->ref, file);
+  file = tmpfile();
+  sort_flush(out->ref, file);
+  rewind(file);
+  const m_bool ret = ref_build(file, refs);
+  fclose(file);
+  return ret;
+}
+
+// retag only the inputs whose size, mtime and then content changed
+// since the last run, and splice them into the existing tags file.
+// the inputs are the whole set: files missing from them are dropped.
+static m_bool tag_update(Scanner* scan, TagOut* tags, Vector files,
+    const m_str out, const m_str refs, const m_str deps, m_bool update,
+    const m_uint jobs, m_bool* written) {
+  Manifest m = { NULL, 0, 0, 0 };
+  char manifest[strlen(out) + 10], tmp[strlen(out) + 5];
+  const size_t size = vector_size(files) * sizeof(Job);
+  // without shared memory for the workers, the files are tagged here
+  Job* job = jobs > 1 ? pool_shared(size) : NULL;
+  const m_bool shared = job != NULL;
+  m_uint n = 0;
+  if(!shared)
+    job = malloc(size);
+  if(update && access(out, R_OK)) {
+    fprintf(stderr, "%s: no tags file to update, writing a new one\n", out);
+    update = 0;
+  }
+  if(update && refs && access(refs, R_OK)) {
+    fprintf(stderr, "%s: no references to update, writing new tags\n", refs);
+    update = 0;
+  }
+  if(update && deps && access(deps, R_OK)) {
+    fprintf(stderr, "%s: no include graph to update, writing new tags\n", deps);
+    update = 0;
+  }
+  m_bool dirty = !update;
+  StatClock clock;
+  sprintf(manifest, "%s.manifest", out);
+  sprintf(tmp, "%s.tmp", out);
+  if(update)
+    manifest_load(&m, manifest);
+  for(m_uint i = 0; i < vector_size(files); i++) {
+    const m_str name = (m_str)vector_at(files, i);
+    struct stat st;
+    if(stat(name, &st))
+      continue;
+    Stamp* stamp = manifest_find(&m, name);
+    if(stamp && stamp->seen)
+      continue;
+    if(stamp) {
+      stamp->seen = 1;
+      if(stamp->mtime == st.st_mtime && stamp->size == st.st_size)
+        continue;
+    }
+    Job j = { name, stamp ? stamp - m.stamp : -1, st.st_size, st.st_mtime,
+      stamp ? stamp->hash : 0, stamp ? stamp->shape : 0, 0, 0 };
+    job[n++] = j;
+  }
+  if(shared && n > 1) {
+    qsort(job, n, sizeof(Job), job_cmp);
+    // the files of a worker that died are missing: keep the old tags
+    if(!tag_pool(tags, job, n, jobs)) {
+      fprintf(stderr, "%s: not written, a worker failed\n", out);
+      pool_unshare(job, size);
+      manifest_release(&m);
+      return 0;
+    }
+  } else if(n) {
+    const char** name = malloc(n * sizeof(char*));
+    for(m_uint i = 0; i < n; i++)
+      name[i] = job[i].name;
+    Prefetch* p = prefetch_start(name, n);
+    for(m_uint i = 0; i < n; i++)
+      tag_job(scan, tags, &job[i], p);
+    prefetch_stop(p);
+    free(name);
+  }
+  for(m_uint i = 0; i < n; i++) {
+    if(!job[i].read) {
+      if(job[i].stamp != -1)
+        m.stamp[job[i].stamp].seen = 0;
+      continue;
+    }
+    if(job[i].changed) {
+      if(job[i].stamp != -1)
+        tag_drop(tags, job[i].name);
+      dirty = 1;
+    }
+    Stamp* stamp = job[i].stamp != -1 ?
+      &m.stamp[job[i].stamp] : manifest_add(&m, job[i].name);
+    stamp->mtime = job[i].mtime;
+    stamp->size = job[i].size;
+    stamp->hash = job[i].hash;
+    stamp->shape = job[i].shape;
+  }
+  if(shared)
+    pool_unshare(job, size);
+  else
+    free(job);
+  for(m_uint i = 0; i < m.sorted; i++)
+    if(!m.stamp[i].seen) {
+      tag_drop(tags, m.stamp[i].path);
+      dirty = 1;
+    }
+  stats_start(&clock);
+  if(dirty) {
+    FILE* file;
+    if(update && !sort_splice(tags->tag, out)) {
+      perror(out);
+      manifest_release(&m);
+      return 0;
+    }
+    if(!(file = fopen(tmp, "w"))) {
+      perror(tmp);
+      manifest_release(&m);
+      return 0;
+    }
+    sort_write(tags->tag, file);
+    fclose(file);
+    if(rename(tmp, out)) {
+      perror(out);
+      manifest_release(&m);
+      return 0;
+    }
+    if(refs && !ref_update(tags, refs, update)) {
+      perror(refs);
+      manifest_release(&m);
+      return 0;
+    }
+    if(deps && !dep_update(tags, deps, update)) {
+      perror(deps);
+      manifest_release(&m);
+      return 0;
+    }
+  }
+  *written = dirty;
+  manifest_write(&m, manifest);
+  manifest_release(&m);
+  stats_stop(&clock, phase_emit);
+  return 1;
+}
+
+static void tag_dir(Vector files, const m_str path) {
+  DIR* dir = opendir(path);
+  struct dirent* ent;
+  if(!dir) {
+    perror(path);
+    return;
+  }
+  while((ent = readdir(dir))) {
+    struct stat st;
+    const size_t len = strlen(ent->d_name);
+    if(*ent->d_name == '.')
+      continue;
+    char name[strlen(path) + len + 2];
+    sprintf(name, "%s/%s", path, ent->d_name);
+    if(lstat(name, &st))
+      continue;
+    if(S_ISDIR(st.st_mode))
+      tag_dir(files, name);
+    else if(S_ISREG(st.st_mode) && len > 3 && !strcmp(ent->d_name + len - 3, ".gw"))
+      vector_add(files, (vtype)strdup(name));
+  }
+  closedir(dir);
+}
+
+static void tag_add(void* data, const char* name) {
+  vector_add((Vector)data, (vtype)strdup(name));
+}
+
+static int tag_deps(const m_str name, const m_str rdeps, const m_bool order) {
+  DepGraph graph;
+  int ret = 0;
+  if(!deps_load(&graph, name)) {
+    fprintf(stderr, "%s: no include graph\n", name);
+    deps_release(&graph);
+    return 2;
+  }
+  if(order)
+    deps_order(&graph, stdout);
+  if(rdeps && !deps_users(&graph, rdeps, stdout))
+    ret = 1;
+  deps_release(&graph);
+  return ret;
+}
+
+static int tag_query(const m_str name, Vector query) {
+  Index idx;
+  m_uint found = 0;
+  if(!index_open(&idx, name)) {
+    fprintf(stderr, "%s: not a gwtag index\n", name);
+    return 2;
+  }
+  for(m_uint i = 0; i < vector_size(query); i += 2) {
+    const m_str str = (m_str)vector_at(query, i + 1);
+    m_uint n;
+    if(vector_at(query, i) == 2) {
+      IndexHit* hit = index_search(&idx, str, &n);
+      for(m_uint j = 0; j < n && j < SEARCH_MAX; j++) {
+        m_uint nrec;
+        const IndexRec* rec = index_find(&idx, idx.pool + idx.rec[hit[j].rec].name, &nrec);
+        for(m_uint k = 0; k < nrec; k++)
+          index_print(&idx, &rec[k], stdout);
+      }
+      found += n;
+      free(hit);
+      continue;
+    }
+    const IndexRec* rec = vector_at(query, i) ?
+      index_prefix(&idx, str, &n) : index_find(&idx, str, &n);
+    for(m_uint j = 0; j < n; j++)
+      index_print(&idx, &rec[j], stdout);
+    found += n;
+  }
+  index_close(&idx);
+  return !found;
+}
+
 int main(int argc, char** argv) {
+  m_str out = NULL, index = NULL, refs = NULL, xref = NULL, daemon = NULL;
+  m_str deps = NULL, rdeps = NULL;
+  m_bool update = 0, trigram = 0, cache_stats = 0, order = 0, locals = 0;
+  m_bool json = 0;
+  m_str cache_dir = NULL;
+  size_t cache_size = CACHE_SIZE;
+  Cache cache;
+  m_uint jobs = 1;
+  int ret = 0;
+  Vector files = new_vector();
+  Vector dirs = new_vector();
+  Vector query = new_vector();
   argc--; argv++;
-  Scanner* scan = new_scanner(127); // magic number
   while(argc--) {
-    Ast ast;
-    Tagger tagger = { *argv , new_vector(), NULL };
-    char c[strlen(*argv) + 6];
-    sprintf(c, "%s.tag", *argv);
-    FILE* f = fopen(*argv, "r");
-    if(!f)continue;
-    if(!(ast = parse(scan, *argv++, f))) {
+    if(!strcmp(*argv, "-o") && argc) {
+      out = *++argv;
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "-R") && argc) {
+      vector_add(dirs, (vtype)*++argv);
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "-j") && argc) {
+      jobs = strtoul(*++argv, NULL, 10);
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "--files-from") && argc) {
+      if(!files_from(*++argv, tag_add, files))
+        ret = 2;
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "-x") && argc) {
+      refs = *++argv;
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "-d") && argc) {
+      deps = *++argv;
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "--rdeps") && argc) {
+      rdeps = *++argv;
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "--order")) {
+      order = 1;
+      ++argv;
+    } else if(!strcmp(*argv, "--refs") && argc) {
+      xref = *++argv;
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "--daemon") && argc) {
+      daemon = *++argv;
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "--cache") && argc) {
+      cache_dir = *++argv;
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "--cache-size") && argc) {
+      cache_size = strtoul(*++argv, NULL, 10) << 20;
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "--cache-stats")) {
+      cache_stats = 1;
+      ++argv;
+    } else if(!strcmp(*argv, "--arena")) {
+      arena_init();
+      ++argv;
+    } else if(!strcmp(*argv, "--stats")) {
+      stats_init("gwtag");
+      ast_stats_init();
+      arena_stats_init();
+      ++argv;
+    } else if(!strcmp(*argv, "-i") && argc) {
+      index = *++argv;
+      ++argv;
+      argc--;
+    } else if((!strcmp(*argv, "--query") || !strcmp(*argv, "--prefix") ||
+        !strcmp(*argv, "--search")) && argc) {
+      vector_add(query, (vtype)(!strcmp(*argv, "--prefix") ? 1 :
+          !strcmp(*argv, "--search") ? 2 : 0));
+      vector_add(query, (vtype)*++argv);
+      ++argv;
+      argc--;
+    } else if(!strcmp(*argv, "--locals")) {
+      locals = 1;
+      ++argv;
+    } else if(!strcmp(*argv, "--json")) {
+      json = 1;
+      ++argv;
+    } else if(!strcmp(*argv, "-t")) {
+      trigram = 1;
+      ++argv;
+    } else if(!strcmp(*argv, "-u")) {
+      update = 1;
+      ++argv;
+    } else
+      vector_add(files, (vtype)strdup(*argv++));
+  }
+  // the symbols go to stdout: there is no tags file to write them next to
+  if(json && (out || daemon)) {
+    fprintf(stderr, "gwtag: --json does not go with %s\n", out ? "-o" : "--daemon");
+    return 2;
+  }
+  for(m_uint i = 0; !daemon && i < vector_size(dirs); i++)
+    tag_dir(files, (m_str)vector_at(dirs, i));
+  const m_uint size = scan_size(scan_bytes(files));
+  Scanner* scan = new_scanner(size);
+  scan_stats_init(size);
+  if(daemon) {
+    TagDaemon d = { scan, locals };
+    ret = tag_daemon(daemon, files, dirs, tag_text, &d);
+  } else if(out) {
+    TagOut tags = { new_sort(), refs ? new_sort() : NULL, deps ? new_sort() : NULL,
+      cache_dir && cache_open(&cache, cache_dir, cache_size) ? &cache : NULL,
+      size, locals };
+    m_bool written = 0;
+    if(!tag_update(scan, &tags, files, out, refs, deps, update, jobs, &written))
+      ret = 2;
+    else if(index && (written || access(index, R_OK))) {
+      StatClock clock;
+      stats_start(&clock);
+      index_build(out, index, trigram);
+      stats_stop(&clock, phase_emit);
+    }
+    free_sort(tags.tag);
+    if(tags.ref)
+      free_sort(tags.ref);
+    if(tags.dep)
+      free_sort(tags.dep);
+    if(tags.cache)
+      cache_close(tags.cache, cache_stats);
+  } else if(vector_size(files)) {
+    const m_uint n = vector_size(files);
+    const char** names = malloc(n * sizeof(char*));
+    for(m_uint i = 0; i < n; i++)
+      names[i] = (const char*)vector_at(files, i);
+    Prefetch* p = prefetch_start(names, n);
+    // every file goes to the one stream, which is flushed when full
+    if(json)
+      setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+    for(m_uint i = 0; i < n; i++) {
+      const m_str name = (m_str)vector_at(files, i);
+      Tagger tagger = { name, NULL, NULL, NULL, 0, NULL, locals, NULL };
+      char c[strlen(name) + 6];
+      StatClock clock;
+      size_t len;
+      Ast ast;
+      stats_start(&clock);
+      char* src = prefetch_next(p, &len);
+      FILE* f = src ? fmemopen(src, len, "r") : NULL;
+      stats_stop(&clock, phase_open);
+      if(!f) {
+        free(src);
+        continue;
+      }
+      stats_start(&clock);
+      if(!locals)
+        skim_bodies(src, len);
+      arena_begin();
+      ast = parse(scan, name, f);
+      arena_end();
+      stats_stop(&clock, phase_parse);
+      if(ast) {
+        ast_stats(ast);
+        sprintf(c, "%s.tag", name);
+        tagger.class_stack = new_vector();
+        if(json) {
+          tagger.uri = tag_uri(name);
+          tagger.file = stdout;
+        } else
+          tagger.file = fopen(c, "w");
+        stats_start(&clock);
+        if(tagger.file)
+          tag_ast(&tagger, ast);
+        if(json)
+          free(tagger.uri);
+        else if(tagger.file)
+          fclose(tagger.file);
+        stats_stop(&clock, phase_walk);
+        stats_start(&clock);
+        release_ast(ast);
+        free_vector(tagger.class_stack);
+        stats_stop(&clock, phase_free);
+      }
       fclose(f);
-      continue;
+      free(src);
     }
-    tagger.file = fopen(c, "w");
-    tag_ast(&tagger, ast);
-    free_ast(ast);
-    free_vector(tagger.class_stack);
-    fclose(tagger.file);
-    fclose(f);
+    prefetch_stop(p);
+    free(names);
+  }
+  if(vector_size(query))
+    ret = tag_query(index ? index : "tags.idx", query);
+  if(xref) {
+    const int found = ref_query(refs ? refs : "tags.refs", xref, stdout);
+    if(found > ret)
+      ret = found;
+  }
+  if(rdeps || order) {
+    const int found = tag_deps(deps ? deps : "tags.deps", rdeps, order);
+    if(found > ret)
+      ret = found;
   }
+  for(m_uint i = 0; i < vector_size(files); i++)
+    free((m_str)vector_at(files, i));
+  free_vector(files);
+  free_vector(dirs);
+  free_vector(query);
   free_scanner(scan);
   free_symbols();
-  return 0;
+  stats_report(stderr);
+  return ret;
 }
+#endif
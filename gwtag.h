@@ -0,0 +1,16 @@
+#ifndef GWTAG_H
+#define GWTAG_H
+
+typedef struct {
+  const m_str  filename;
+  Vector class_stack;
+  FILE*  file;
+  FILE*  refs;
+  m_uint func;
+  FILE*  deps;
+  m_bool locals;  // tag the variables of function bodies too
+  m_str  uri;     // of filename: write json symbols instead of tags
+} Tagger;
+
+void tag_ast(Tagger*, CAst);
+#endif
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "map.h"
+#include "absyn.h"
+#include "hash.h"
+#include "scanner.h"
+#include "astview.h"
+#include "tagfile.h"
+#include "gwtag.h"
+#include "gwpp.h"
+#include "stats.h"
+#include "prefetch.h"
+#include "arena.h"
+#include "scan.h"
+
+// parse each file once, then tag it and print it from the same tree:
+// the tags are sorted into one tags file, the source goes to stdout
+// and the lint warnings to stderr, as gwtag -o and gwpp would.
+static void tools_tag(TagSort* sort, const m_str name, CAst ast) {
+  char* buf;
+  size_t len;
+  StatClock clock;
+  Tagger tagger = { name, new_vector(), NULL, NULL, 0, NULL, 0, NULL };
+  tagger.file = open_memstream(&buf, &len);
+  stats_start(&clock);
+  tag_ast(&tagger, ast);
+  stats_stop(&clock, phase_walk);
+  fclose(tagger.file);
+  free_vector(tagger.class_stack);
+  stats_start(&clock);
+  sort_add(sort, buf, len);
+  stats_stop(&clock, phase_emit);
+  free(buf);
+}
+
+static void tools_lint(const m_str name, CAst ast, const m_uint jobs) {
+  Linter linter = { name, stdout, 1, ftell(stdout), 0, 0, 0, 0, NULL };
+  StatClock clock;
+  stats_start(&clock);
+  if(jobs > 1 && ast->next)
+    lint_ast_parallel(&linter, ast, jobs);
+  else
+    lint_ast(&linter, ast);
+  stats_stop(&clock, phase_walk);
+}
+
+static void tools_add(void* data, const char* name) {
+  vector_add((Vector)data, (vtype)strdup(name));
+}
+
+int main(int argc, char** argv) {
+  m_str out = "tags";
+  m_uint jobs = 1;
+  m_bool lint = 0;
+  int ret = 0;
+  TagSort* sort = new_sort();
+  Vector files = new_vector();
+  argc--; argv++;
+  while(argc--) {
+    if(!strcmp(*argv, "-l")) {
+      lint = 1;
+      ++argv;
+      continue;
+    }
+    if(!strcmp(*argv, "-j") && argc) {
+      jobs = strtoul(*++argv, NULL, 10);
+      ++argv;
+      argc--;
+      continue;
+    }
+    if(!strcmp(*argv, "-o") && argc) {
+      out = *++argv;
+      ++argv;
+      argc--;
+      continue;
+    }
+    if(!strcmp(*argv, "--files-from") && argc) {
+      if(!files_from(*++argv, tools_add, files))
+        ret = 2;
+      ++argv;
+      argc--;
+      continue;
+    }
+    if(!strcmp(*argv, "--arena")) {
+      arena_init();
+      ++argv;
+      continue;
+    }
+    if(!strcmp(*argv, "--stats")) {
+      stats_init("gwtools");
+      ast_stats_init();
+      arena_stats_init();
+      ++argv;
+      continue;
+    }
+    vector_add(files, (vtype)strdup(*argv++));
+  }
+  const m_uint size = scan_size(scan_bytes(files));
+  Scanner* scan = new_scanner(size);
+  scan->lint = lint;
+  scan_stats_init(size);
+  const m_uint n = vector_size(files);
+  const char** names = malloc(n * sizeof(char*));
+  for(m_uint i = 0; i < n; i++)
+    names[i] = (const char*)vector_at(files, i);
+  Prefetch* p = prefetch_start(names, n);
+  for(m_uint i = 0; i < n; i++) {
+    Ast ast;
+    StatClock clock;
+    size_t len;
+    const m_str name = (m_str)vector_at(files, i);
+    stats_start(&clock);
+    char* src = prefetch_next(p, &len);
+    FILE* f = src ? fmemopen(src, len, "r") : NULL;
+    stats_stop(&clock, phase_open);
+    if(!f) {
+      free(src);
+      continue;
+    }
+    stats_start(&clock);
+    arena_begin();
+    ast = parse(scan, name, f);
+    arena_end();
+    stats_stop(&clock, phase_parse);
+    if(ast) {
+      ast_stats(ast);
+      tools_tag(sort, name, ast);
+      tools_lint(name, ast, jobs);
+      stats_start(&clock);
+      release_ast(ast);
+      stats_stop(&clock, phase_free);
+    }
+    fclose(f);
+    free(src);
+  }
+  prefetch_stop(p);
+  free(names);
+  StatClock clock;
+  stats_start(&clock);
+  FILE* file = fopen(out, "w");
+  if(file) {
+    sort_write(sort, file);
+    fclose(file);
+    stats_stop(&clock, phase_emit);
+  } else {
+    perror(out);
+    ret = 2;
+  }
+  free_sort(sort);
+  for(m_uint i = 0; i < n; i++)
+    free((m_str)vector_at(files, i));
+  free_vector(files);
+  free_scanner(scan);
+  free_symbols();
+  stats_report(stderr);
+  return ret;
+}
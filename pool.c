@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "defs.h"
+#include "pool.h"
+
+typedef struct {
+  pthread_mutex_t lock;
+  m_uint head, tail;
+} Deque;
+
+typedef struct {
+  Deque* deque;
+  m_uint* queue;
+  m_uint n;
+} Shared;
+
+void* pool_shared(const size_t size) {
+  void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  return ptr != MAP_FAILED ? ptr : NULL;
+}
+
+void pool_unshare(void* ptr, const size_t size) {
+  munmap(ptr, size);
+}
+
+static m_bool deque_pop(Deque* d, m_uint* job, const m_bool steal) {
+  m_bool ret = 0;
+  pthread_mutex_lock(&d->lock);
+  if(d->head < d->tail) {
+    *job = steal ? --d->tail : d->head++;
+    ret = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return ret;
+}
+
+static m_bool pool_steal(Shared* s, const m_uint self, m_uint* job) {
+  while(1) {
+    Deque* victim = NULL;
+    m_uint max = 0;
+    for(m_uint i = 0; i < s->n; i++) {
+      const m_uint head = __atomic_load_n(&s->deque[i].head, __ATOMIC_RELAXED);
+      const m_uint tail = __atomic_load_n(&s->deque[i].tail, __ATOMIC_RELAXED);
+      const m_uint left = tail > head ? tail - head : 0;
+      if(i != self && left > max) {
+        max = left;
+        victim = &s->deque[i];
+      }
+    }
+    if(!victim)
+      return 0;
+    if(deque_pop(victim, job, 1))
+      return 1;
+  }
+}
+
+static void pool_worker(Pool* pool, Shared* s, const m_uint self) {
+  m_uint i;
+  if(pool->init)
+    pool->init(pool->data, self);
+  while(deque_pop(&s->deque[self], &i, 0) || pool_steal(s, self, &i))
+    pool->run(pool->data, self, s->queue[i]);
+  if(pool->end)
+    pool->end(pool->data, self);
+}
+
+// jobs are dealt round robin in the given order, so put the big ones first.
+// the calling process is worker 0. the jobs a worker took die with it:
+// this fails if any worker did not exit cleanly.
+m_bool pool_run(Pool* pool, m_uint workers, const m_uint* order, const m_uint n) {
+  if(!workers)
+    workers = 1;
+  const size_t size = workers * sizeof(Deque) + n * sizeof(m_uint);
+  pthread_mutexattr_t attr;
+  pid_t pid[workers];
+  Shared s;
+  m_bool ret = 1;
+  if(!(s.deque = pool_shared(size))) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  s.queue = (m_uint*)(s.deque + workers);
+  s.n = workers;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  for(m_uint w = 0, j = 0; w < workers; w++) {
+    pthread_mutex_init(&s.deque[w].lock, &attr);
+    s.deque[w].head = j;
+    for(m_uint i = w; i < n; i += workers)
+      s.queue[j++] = order[i];
+    s.deque[w].tail = j;
+  }
+  pthread_mutexattr_destroy(&attr);
+  fflush(NULL);
+  for(m_uint w = 1; w < workers; w++) {
+    if(!(pid[w] = fork())) {
+      pool_worker(pool, &s, w);
+      fflush(NULL);
+      _exit(EXIT_SUCCESS);
+    }
+    if(pid[w] == -1)
+      perror("fork");
+  }
+  pool_worker(pool, &s, 0);
+  for(m_uint w = 1; w < workers; w++) {
+    int status;
+    if(pid[w] == -1 || waitpid(pid[w], &status, 0) == -1)
+      continue;
+    if(WIFSIGNALED(status)) {
+      fprintf(stderr, "worker %lu: killed by signal %i\n",
+          (unsigned long)w, WTERMSIG(status));
+      ret = 0;
+    } else if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+      fprintf(stderr, "worker %lu: exited with status %i\n",
+          (unsigned long)w, WEXITSTATUS(status));
+      ret = 0;
+    }
+  }
+  for(m_uint w = 0; w < workers; w++)
+    pthread_mutex_destroy(&s.deque[w].lock);
+  pool_unshare(s.deque, size);
+  return ret;
+}
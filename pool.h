@@ -0,0 +1,17 @@
+#ifndef POOL_H
+#define POOL_H
+
+// worker processes with per-worker deques in shared memory.
+// workers pop jobs from the front of their own deque
+// and steal from the back of the fullest one once it is empty.
+typedef struct {
+  void (*init)(void*, const m_uint);
+  void (*run)(void*, const m_uint, const m_uint);
+  void (*end)(void*, const m_uint);
+  void* data;
+} Pool;
+
+void* pool_shared(const size_t);
+void pool_unshare(void*, const size_t);
+m_bool pool_run(Pool*, m_uint, const m_uint*, const m_uint);
+#endif
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "prefetch.h"
+
+typedef struct {
+  char*  buf;
+  size_t len;
+} Slot;
+
+struct Prefetch_ {
+  const char* const* name;
+  size_t             n;
+  size_t             done, taken;  // files read and files handed out
+  int                stop;
+  Slot               slot[PREFETCH_AHEAD];
+  pthread_mutex_t    lock;
+  pthread_cond_t     cond;
+  pthread_t          thread;
+};
+
+int files_from(const char* path, void (*add)(void*, const char*), void* data) {
+  FILE* file = strcmp(path, "-") ? fopen(path, "r") : stdin;
+  char* name = NULL;
+  size_t size = 0;
+  ssize_t len;
+  if(!file) {
+    perror(path);
+    return 0;
+  }
+  while((len = getdelim(&name, &size, '\0', file)) != -1) {
+    if(len && name[len - 1] == '\0')
+      len--;
+    if(len) {
+      name[len] = '\0';
+      add(data, name);
+    }
+  }
+  free(name);
+  if(file != stdin)
+    fclose(file);
+  return 1;
+}
+
+char* prefetch_read(const char* name, size_t* len) {
+  struct stat st;
+  char* buf = NULL;
+  const int fd = open(name, O_RDONLY);
+  if(fd == -1)
+    return NULL;
+  if(!fstat(fd, &st) && (buf = malloc(st.st_size + 1))) {
+    size_t n = 0;
+    ssize_t r;
+    while(n < (size_t)st.st_size &&
+        (r = read(fd, buf + n, st.st_size - n)) > 0)
+      n += r;
+    if(n != (size_t)st.st_size) {
+      free(buf);
+      buf = NULL;
+    } else {
+      buf[n] = '\0';
+      *len = n;
+    }
+  }
+  close(fd);
+  return buf;
+}
+
+static void* prefetch_thread(void* data) {
+  Prefetch* p = (Prefetch*)data;
+  for(size_t i = 0; i < p->n; i++) {
+    Slot slot = { NULL, 0 };
+    pthread_mutex_lock(&p->lock);
+    while(!p->stop && i - p->taken == PREFETCH_AHEAD)
+      pthread_cond_wait(&p->cond, &p->lock);
+    const int stop = p->stop;
+    pthread_mutex_unlock(&p->lock);
+    if(stop)
+      break;
+    slot.buf = prefetch_read(p->name[i], &slot.len);
+    pthread_mutex_lock(&p->lock);
+    p->slot[i % PREFETCH_AHEAD] = slot;
+    p->done++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+  }
+  return NULL;
+}
+
+Prefetch* prefetch_start(const char* const* name, const size_t n) {
+  Prefetch* p = calloc(1, sizeof(Prefetch));
+  p->name = name;
+  p->n = n;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->cond, NULL);
+  if(pthread_create(&p->thread, NULL, prefetch_thread, p)) {
+    // no thread: read in the caller's stead
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->lock);
+    p->stop = -1;
+  }
+  return p;
+}
+
+char* prefetch_next(Prefetch* p, size_t* len) {
+  Slot slot;
+  if(p->taken == p->n)
+    return NULL;
+  if(p->stop == -1)
+    return prefetch_read(p->name[p->taken++], len);
+  pthread_mutex_lock(&p->lock);
+  while(p->done == p->taken)
+    pthread_cond_wait(&p->cond, &p->lock);
+  slot = p->slot[p->taken++ % PREFETCH_AHEAD];
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+  *len = slot.len;
+  return slot.buf;
+}
+
+void prefetch_stop(Prefetch* p) {
+  if(p->stop != -1) {
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->lock);
+  }
+  while(p->taken < p->done)
+    free(p->slot[p->taken++ % PREFETCH_AHEAD].buf);
+  free(p);
+}
@@ -0,0 +1,23 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#define PREFETCH_AHEAD 16
+
+// NUL separated paths from a file, or from stdin for "-",
+// each handed to the callback. 0 if the list can not be read.
+int files_from(const char*, void (*)(void*, const char*), void*);
+
+// the whole file, with a NUL after it for the parser's sake.
+// NULL if it could not be read, the caller frees it otherwise.
+char* prefetch_read(const char*, size_t*);
+
+// a thread reads the files in order, up to PREFETCH_AHEAD of them
+// ahead of the caller, while the caller parses the previous ones.
+typedef struct Prefetch_ Prefetch;
+
+Prefetch* prefetch_start(const char* const*, const size_t);
+// the contents of the next file, NULL if it could not be read.
+// the caller frees it.
+char* prefetch_next(Prefetch*, size_t*);
+void prefetch_stop(Prefetch*);
+#endif
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "defs.h"
+#include "map.h"
+#include "hash.h"
+#include "scan.h"
+#include "stats.h"
+#include "arena.h"
+
+static const char* const scan_key[] = { "buckets", "symbols", "chains", "chain_max" };
+#define SCAN_KEYS (sizeof(scan_key) / sizeof(*scan_key))
+
+// the symbols seen, an open addressed set of pointers
+typedef struct {
+  Symbol*   set;
+  m_uint    n, cap;
+  uint32_t* chain;
+  m_uint    buckets, chains, chain_max;
+  uint64_t* count;
+} ScanStats;
+
+static ScanStats scan;
+
+size_t scan_bytes(Vector files) {
+  size_t bytes = 0;
+  for(m_uint i = 0; i < vector_size(files); i++) {
+    struct stat st;
+    if(!stat((m_str)vector_at(files, i), &st))
+      bytes += st.st_size;
+  }
+  return bytes;
+}
+
+Symbol __real_insert_symbol(const char*);
+
+// the symbol table is never freed: what the parser interns stays out of
+// the arena, where it would pin the chunks of every file that has new names
+Symbol __wrap_insert_symbol(const char* name) {
+  const int on = arena_pause();
+  const Symbol sym = __real_insert_symbol(name);
+  arena_resume(on);
+  return sym;
+}
+
+m_uint scan_size(const size_t bytes) {
+  m_uint size = SCAN_MIN;
+  while(size < SCAN_MAX && size * 3 / 4 < bytes / SCAN_BYTES)
+    size = size * 2 + 1;
+  return size;
+}
+
+void scan_stats_init(const m_uint buckets) {
+  if(!stats || !(scan.count = stats_group("symtab", scan_key, SCAN_KEYS)))
+    return;
+  scan.buckets = buckets;
+  scan.chain = calloc(buckets, sizeof(uint32_t));
+  scan.cap = 1024;
+  scan.set = calloc(scan.cap, sizeof(Symbol));
+  scan.count[0] = buckets;
+}
+
+static m_uint scan_hash(const char* s) {
+  m_uint h = 0;
+  for(; *s; s++)
+    h = h * 65599 + (unsigned char)*s;
+  return h;
+}
+
+static m_bool scan_add(Symbol sym) {
+  m_uint i = ((uintptr_t)sym >> 4) & (scan.cap - 1);
+  while(scan.set[i]) {
+    if(scan.set[i] == sym)
+      return 0;
+    i = (i + 1) & (scan.cap - 1);
+  }
+  scan.set[i] = sym;
+  return 1;
+}
+
+static void scan_grow(void) {
+  Symbol* old = scan.set;
+  const m_uint cap = scan.cap;
+  scan.cap *= 2;
+  scan.set = calloc(scan.cap, sizeof(Symbol));
+  for(m_uint i = 0; i < cap; i++)
+    if(old[i])
+      scan_add(old[i]);
+  free(old);
+}
+
+void scan_symbol(Symbol sym) {
+  if(!scan.chain || !sym)
+    return;
+  if(!scan_add(sym))
+    return;
+  if(++scan.n * 2 > scan.cap)
+    scan_grow();
+  const uint32_t len = ++scan.chain[scan_hash(s_name(sym)) % scan.buckets];
+  if(len == 1)
+    scan.chains++;
+  if(len > scan.chain_max)
+    scan.chain_max = len;
+}
+
+// every process has its own table: the report keeps the fullest
+void scan_stats(void) {
+  if(!scan.chain)
+    return;
+  stats_max(&scan.count[1], scan.n);
+  stats_max(&scan.count[2], scan.chains);
+  stats_max(&scan.count[3], scan.chain_max);
+}
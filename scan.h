@@ -0,0 +1,19 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#define SCAN_MIN 127
+#define SCAN_MAX ((1 << 20) - 1)
+// source bytes per distinct identifier, roughly
+#define SCAN_BYTES 256
+
+// the size handed to new_scanner: enough buckets for the identifiers
+// that many bytes of source should hold, at a load under 3/4
+m_uint scan_size(const size_t);
+size_t scan_bytes(Vector);
+
+// for --stats: the symbols the trees hold, hashed into as many buckets,
+// give the chains a table of that size would have to walk
+void scan_stats_init(const m_uint);
+void scan_symbol(Symbol);
+void scan_stats(void);
+#endif
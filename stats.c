@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+typedef struct {
+  const char*        name;
+  const char* const* key;
+  size_t             n;
+  uint64_t*          count;
+} StatGroup;
+
+// shared with forked workers, so every counter is added to atomically
+struct Stats_ {
+  const char* tool;
+  uint64_t    wall[STATS_PHASES], cpu[STATS_PHASES];
+  uint64_t    rchar, wchar;
+  uint64_t    alloc[STATS_ALLOCS];
+  StatGroup   group[STATS_GROUPS];
+  size_t      ngroup;
+  uint64_t    count[STATS_COUNTERS];
+  size_t      ncount;
+};
+
+struct Stats_* stats;
+
+static const char* const phase_name[STATS_PHASES] = {
+  "open", "parse", "walk", "emit", "free"
+};
+
+static const char* const alloc_name[STATS_ALLOCS] = {
+  "malloc", "calloc", "realloc", "free", "arena"
+};
+
+void stats_alloc(const unsigned kind) {
+  __atomic_fetch_add(&stats->alloc[kind], 1, __ATOMIC_RELAXED);
+}
+
+void stats_init(const char* tool) {
+  struct Stats_* s = mmap(NULL, sizeof(struct Stats_), PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(s == MAP_FAILED)
+    return;
+  memset(s, 0, sizeof(struct Stats_));
+  s->tool = tool;
+  stats = s;
+}
+
+static uint64_t clock_ns(const clockid_t id) {
+  struct timespec ts;
+  clock_gettime(id, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void stats_start(StatClock* clock) {
+  if(!stats)
+    return;
+  clock->wall = clock_ns(CLOCK_MONOTONIC);
+  clock->cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void stats_stop(const StatClock* clock, const int phase) {
+  if(!stats)
+    return;
+  __atomic_fetch_add(&stats->wall[phase], clock_ns(CLOCK_MONOTONIC) - clock->wall,
+      __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stats->cpu[phase], clock_ns(CLOCK_PROCESS_CPUTIME_ID) - clock->cpu,
+      __ATOMIC_RELAXED);
+}
+
+uint64_t* stats_group(const char* name, const char* const* key, const size_t n) {
+  if(!stats || stats->ngroup == STATS_GROUPS || stats->ncount + n > STATS_COUNTERS)
+    return NULL;
+  StatGroup* g = &stats->group[stats->ngroup++];
+  g->name = name;
+  g->key = key;
+  g->n = n;
+  g->count = stats->count + stats->ncount;
+  stats->ncount += n;
+  return g->count;
+}
+
+void stats_count(uint64_t* count, const uint64_t n) {
+  __atomic_fetch_add(count, n, __ATOMIC_RELAXED);
+}
+
+void stats_max(uint64_t* count, const uint64_t n) {
+  uint64_t prev = __atomic_load_n(count, __ATOMIC_RELAXED);
+  while(prev < n && !__atomic_compare_exchange_n(count, &prev, n, 1,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// bytes that went through read(2) and write(2), whatever the file
+static void stats_io(uint64_t* rchar, uint64_t* wchar) {
+  FILE* file = fopen("/proc/self/io", "r");
+  char key[32];
+  unsigned long long val;
+  *rchar = *wchar = 0;
+  if(!file)
+    return;
+  while(fscanf(file, "%31[^:]: %llu\n", key, &val) == 2) {
+    if(!strcmp(key, "rchar"))
+      *rchar = val;
+    else if(!strcmp(key, "wchar"))
+      *wchar = val;
+  }
+  fclose(file);
+}
+
+void stats_worker(void) {
+  uint64_t rchar, wchar;
+  if(!stats)
+    return;
+  stats_io(&rchar, &wchar);
+  __atomic_fetch_add(&stats->rchar, rchar, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stats->wchar, wchar, __ATOMIC_RELAXED);
+}
+
+void stats_report(FILE* out) {
+  struct rusage self, children;
+  uint64_t rchar, wchar;
+  if(!stats)
+    return;
+  fflush(stdout);
+  stats_io(&rchar, &wchar);
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+  fprintf(out, "{\"tool\":\"%s\",\"phases\":{", stats->tool);
+  for(int i = 0; i < STATS_PHASES; i++)
+    fprintf(out, "%s\"%s\":{\"wall_ns\":%llu,\"cpu_ns\":%llu}", i ? "," : "",
+        phase_name[i], (unsigned long long)stats->wall[i],
+        (unsigned long long)stats->cpu[i]);
+  fprintf(out, "},\"bytes\":{\"read\":%llu,\"written\":%llu},\"alloc\":{",
+      (unsigned long long)(rchar + stats->rchar),
+      (unsigned long long)(wchar + stats->wchar));
+  for(int i = 0; i < STATS_ALLOCS; i++)
+    fprintf(out, "%s\"%s\":%llu", i ? "," : "", alloc_name[i],
+        (unsigned long long)stats->alloc[i]);
+  fprintf(out, "},\"rss_kb\":{\"peak\":%ld,\"children\":%ld},\"nodes\":{",
+      self.ru_maxrss, children.ru_maxrss);
+  for(size_t i = 0; i < stats->ngroup; i++) {
+    const StatGroup* g = &stats->group[i];
+    fprintf(out, "%s\"%s\":{", i ? "," : "", g->name);
+    for(size_t j = 0, k = 0; j < g->n; j++)
+      if(g->key[j])
+        fprintf(out, "%s\"%s\":%llu", k++ ? "," : "", g->key[j],
+            (unsigned long long)g->count[j]);
+    fprintf(out, "}");
+  }
+  fprintf(out, "}}\n");
+}
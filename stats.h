@@ -0,0 +1,34 @@
+#ifndef STATS_H
+#define STATS_H
+#include <stdio.h>
+#include <stdint.h>
+
+#define STATS_GROUPS 8
+#define STATS_COUNTERS 256
+
+enum { phase_open, phase_parse, phase_walk, phase_emit, phase_free, STATS_PHASES };
+// calls to the allocator, and the blocks of them the arena served
+enum { alloc_malloc, alloc_calloc, alloc_realloc, alloc_free, alloc_arena,
+  STATS_ALLOCS };
+
+typedef struct {
+  uint64_t wall, cpu;
+} StatClock;
+
+// NULL until stats_init: every entry point is a test of it when disabled
+extern struct Stats_* stats;
+
+void stats_init(const char*);
+void stats_start(StatClock*);
+void stats_stop(const StatClock*, const int);
+// named counters, registered before any worker is forked
+uint64_t* stats_group(const char*, const char* const*, const size_t);
+void stats_count(uint64_t*, const uint64_t);
+void stats_max(uint64_t*, const uint64_t);
+// counted from the allocator wrappers in arena.c
+void stats_alloc(const unsigned);
+// a forked worker hands its i/o counts over before exiting
+void stats_worker(void);
+// one JSON object on a line
+void stats_report(FILE*);
+#endif
@@ -0,0 +1,565 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
+#include "defs.h"
+#include "map.h"
+#include "tagfile.h"
+#include "tagd.h"
+#include "prefetch.h"
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | \
+  IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_ONLYDIR)
+
+typedef struct Def_ {
+  struct Def_* next;
+  const char*  line;
+  uint32_t     len, nlen;
+} Def;
+
+typedef struct {
+  m_str    name;
+  uint64_t hash;
+  char*    buf;
+  Def*     def;
+  m_uint   ndef;
+} File;
+
+typedef struct {
+  int    wd;
+  m_str  prefix;
+  m_bool recursive;
+} Watch;
+
+typedef struct {
+  int    fd;
+  char   buf[1024];
+  size_t len;
+} Client;
+
+typedef struct {
+  Def**    slot;
+  m_uint   nslot, ndef;
+  File*    file;
+  m_uint   nfile, cap;
+  m_uint*  fslot;
+  m_uint   nfslot;
+  Watch*   watch;
+  m_uint   nwatch, wcap;
+  Def**    sorted;  // every def by name, kept so as each file is retagged
+  m_uint   nsorted, scap;
+  TagText  text;
+  void*    data;
+  int      ino;
+} Daemon;
+
+static volatile sig_atomic_t done;
+
+static void daemon_signal(int sig __attribute__((unused))) {
+  done = 1;
+}
+
+static uint32_t name_hash(const char* str, const size_t len) {
+  return (uint32_t)tag_hash(str, len);
+}
+
+static void def_grow(Daemon* d) {
+  Def** slot = d->slot;
+  const m_uint n = d->nslot;
+  d->nslot = n ? n * 2 : 1024;
+  d->slot = calloc(d->nslot, sizeof(Def*));
+  for(m_uint i = 0; i < n; i++) {
+    Def* def = slot[i];
+    while(def) {
+      Def* next = def->next;
+      const m_uint h = name_hash(def->line, def->nlen) & (d->nslot - 1);
+      def->next = d->slot[h];
+      d->slot[h] = def;
+      def = next;
+    }
+  }
+  free(slot);
+}
+
+static Def** def_bucket(Daemon* d, const char* name, const size_t len) {
+  return &d->slot[name_hash(name, len) & (d->nslot - 1)];
+}
+
+static int name_cmp(const Def* x, const Def* y) {
+  const int ret = memcmp(x->line, y->line, x->nlen < y->nlen ? x->nlen : y->nlen);
+  return ret ? ret : (x->nlen > y->nlen) - (x->nlen < y->nlen);
+}
+
+// a file's defs of one name stay in the order of their lines
+static int def_cmp(const void* a, const void* b) {
+  const Def* x = a, *y = b;
+  const int ret = name_cmp(x, y);
+  return ret ? ret : (x->line > y->line) - (x->line < y->line);
+}
+
+// the defs of one name are ordered by address, so any def has one place
+static int def_order(const Def* x, const Def* y) {
+  const int ret = name_cmp(x, y);
+  return ret ? ret : (x > y) - (x < y);
+}
+
+// the first place in [lo, hi) of the sorted view that is not before def
+static m_uint sorted_find(const Daemon* d, const Def* def, m_uint lo, m_uint hi) {
+  while(lo < hi) {
+    const m_uint mid = lo + (hi - lo) / 2;
+    if(def_order(d->sorted[mid], def) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// a file's defs are sorted as they are learnt: they come in and go out
+// of the sorted view in one pass, each found by a binary search and the
+// entries between them moved as blocks
+static void sorted_insert(Daemon* d, File* file) {
+  m_uint end = d->nsorted;
+  if(d->nsorted + file->ndef > d->scap) {
+    while(d->nsorted + file->ndef > d->scap)
+      d->scap = d->scap ? d->scap * 2 : 1024;
+    d->sorted = realloc(d->sorted, d->scap * sizeof(Def*));
+  }
+  for(m_uint i = file->ndef; i--;) {
+    const m_uint at = sorted_find(d, &file->def[i], 0, end);
+    memmove(&d->sorted[at + i + 1], &d->sorted[at], (end - at) * sizeof(Def*));
+    d->sorted[at + i] = &file->def[i];
+    end = at;
+  }
+  d->nsorted += file->ndef;
+}
+
+static void sorted_remove(Daemon* d, File* file) {
+  m_uint from = 0;
+  for(m_uint i = 0; i < file->ndef; i++) {
+    const m_uint at = sorted_find(d, &file->def[i], from, d->nsorted);
+    memmove(&d->sorted[from - i], &d->sorted[from], (at - from) * sizeof(Def*));
+    from = at + 1;
+  }
+  memmove(&d->sorted[from - file->ndef], &d->sorted[from],
+      (d->nsorted - from) * sizeof(Def*));
+  d->nsorted -= file->ndef;
+}
+
+// the file's tags leave the table, its buffer is kept for the caller
+static void file_forget(Daemon* d, File* file) {
+  sorted_remove(d, file);
+  for(m_uint i = 0; i < file->ndef; i++) {
+    Def* def = &file->def[i];
+    Def** p = def_bucket(d, def->line, def->nlen);
+    while(*p != def)
+      p = &(*p)->next;
+    *p = def->next;
+  }
+  d->ndef -= file->ndef;
+  free(file->def);
+  free(file->buf);
+  file->def = NULL;
+  file->buf = NULL;
+  file->ndef = 0;
+  file->hash = 0;
+}
+
+static void file_learn(Daemon* d, File* file, char* buf, const size_t len) {
+  m_uint n = 0;
+  for(size_t i = 0; i < len; i++)
+    n += buf[i] == '\n';
+  while((d->ndef + n) > d->nslot)
+    def_grow(d);
+  file->buf = buf;
+  file->def = malloc(n * sizeof(Def));
+  for(char* line = buf; line < buf + len;) {
+    char* end = memchr(line, '\n', buf + len - line);
+    if(!end)
+      break;
+    char* tab = memchr(line, '\t', end - line);
+    if(tab) {
+      Def* def = &file->def[file->ndef++];
+      def->line = line;
+      def->len = end - line + 1;
+      def->nlen = tab - line;
+    }
+    line = end + 1;
+  }
+  qsort(file->def, file->ndef, sizeof(Def), def_cmp);
+  for(m_uint i = 0; i < file->ndef; i++) {
+    Def* def = &file->def[i];
+    Def** p = def_bucket(d, def->line, def->nlen);
+    def->next = *p;
+    *p = def;
+  }
+  d->ndef += file->ndef;
+  sorted_insert(d, file);
+}
+
+static File* file_find(Daemon* d, const m_str name, const m_bool add) {
+  if(d->nfile * 2 >= d->nfslot) {
+    free(d->fslot);
+    d->nfslot = d->nfslot ? d->nfslot * 2 : 1024;
+    d->fslot = calloc(d->nfslot, sizeof(m_uint));
+    for(m_uint i = 0; i < d->nfile; i++) {
+      const char* str = d->file[i].name;
+      m_uint h = name_hash(str, strlen(str)) & (d->nfslot - 1);
+      while(d->fslot[h])
+        h = (h + 1) & (d->nfslot - 1);
+      d->fslot[h] = i + 1;
+    }
+  }
+  m_uint h = name_hash(name, strlen(name)) & (d->nfslot - 1);
+  while(d->fslot[h]) {
+    if(!strcmp(d->file[d->fslot[h] - 1].name, name))
+      return &d->file[d->fslot[h] - 1];
+    h = (h + 1) & (d->nfslot - 1);
+  }
+  if(!add)
+    return NULL;
+  if(d->nfile == d->cap) {
+    d->cap = d->cap ? d->cap * 2 : 256;
+    d->file = realloc(d->file, d->cap * sizeof(File));
+  }
+  File* file = &d->file[d->nfile];
+  memset(file, 0, sizeof(File));
+  file->name = strdup(name);
+  d->fslot[h] = ++d->nfile;
+  return file;
+}
+
+// retag name unless its content did not change
+static void daemon_tag(Daemon* d, const m_str name) {
+  size_t size, len;
+  char* src = prefetch_read(name, &size);
+  File* file = file_find(d, name, 1);
+  if(!src) {
+    file_forget(d, file);
+    return;
+  }
+  const uint64_t hash = tag_hash(src, size);
+  if(file->buf && file->hash == hash) {
+    free(src);
+    return;
+  }
+  file_forget(d, file);
+  char* buf = d->text(d->data, file->name, src, size, &len);
+  free(src);
+  if(!buf)
+    return;
+  file_learn(d, file, buf, len);
+  file->hash = hash;
+}
+
+static m_bool is_source(const char* name) {
+  const size_t len = strlen(name);
+  return len > 3 && !strcmp(name + len - 3, ".gw");
+}
+
+static Watch* watch_find(Daemon* d, const int wd) {
+  for(m_uint i = 0; i < d->nwatch; i++)
+    if(d->watch[i].wd == wd)
+      return &d->watch[i];
+  return NULL;
+}
+
+// prefix is what comes before the entry names, "" for the current dir
+static void daemon_watch(Daemon* d, const m_str prefix, const m_bool recursive) {
+  const int wd = inotify_add_watch(d->ino, *prefix ? prefix : ".", WATCH_MASK);
+  if(wd == -1) {
+    perror(prefix);
+    return;
+  }
+  Watch* w = watch_find(d, wd);
+  if(w) {
+    w->recursive |= recursive;
+    if(!recursive)
+      return;
+  } else {
+    if(d->nwatch == d->wcap) {
+      d->wcap = d->wcap ? d->wcap * 2 : 64;
+      d->watch = realloc(d->watch, d->wcap * sizeof(Watch));
+    }
+    Watch watch = { wd, strdup(prefix), recursive };
+    d->watch[d->nwatch++] = watch;
+  }
+  if(!recursive)
+    return;
+  DIR* dir = opendir(*prefix ? prefix : ".");
+  struct dirent* ent;
+  if(!dir)
+    return;
+  while((ent = readdir(dir))) {
+    struct stat st;
+    if(*ent->d_name == '.')
+      continue;
+    char name[strlen(prefix) + strlen(ent->d_name) + 2];
+    sprintf(name, "%s%s", prefix, ent->d_name);
+    if(lstat(name, &st))
+      continue;
+    if(S_ISDIR(st.st_mode)) {
+      strcat(name, "/");
+      daemon_watch(d, name, 1);
+    } else if(S_ISREG(st.st_mode) && is_source(ent->d_name))
+      daemon_tag(d, name);
+  }
+  closedir(dir);
+}
+
+static void daemon_forget_dir(Daemon* d, const m_str prefix) {
+  const size_t len = strlen(prefix);
+  for(m_uint i = 0; i < d->nfile; i++)
+    if(d->file[i].buf && !strncmp(d->file[i].name, prefix, len))
+      file_forget(d, &d->file[i]);
+}
+
+static void daemon_event(Daemon* d, const struct inotify_event* ev) {
+  Watch* w = watch_find(d, ev->wd);
+  if(!w)
+    return;
+  if(ev->mask & (IN_IGNORED | IN_DELETE_SELF)) {
+    w->wd = -1;
+    return;
+  }
+  if(!ev->len || *ev->name == '.')
+    return;
+  char name[strlen(w->prefix) + strlen(ev->name) + 2];
+  sprintf(name, "%s%s", w->prefix, ev->name);
+  if(ev->mask & IN_ISDIR) {
+    strcat(name, "/");
+    if(ev->mask & (IN_DELETE | IN_MOVED_FROM))
+      daemon_forget_dir(d, name);
+    else if(w->recursive)
+      daemon_watch(d, name, 1);
+    return;
+  }
+  File* file = file_find(d, name, 0);
+  if(!file && !(w->recursive && is_source(ev->name)))
+    return;
+  if(ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+    if(file)
+      file_forget(d, file);
+  } else if(ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+    daemon_tag(d, name);
+}
+
+static void daemon_inotify(Daemon* d) {
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while((len = read(d->ino, buf, sizeof(buf))) > 0) {
+    for(char* p = buf; p < buf + len;) {
+      const struct inotify_event* ev = (const struct inotify_event*)p;
+      daemon_event(d, ev);
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+}
+
+static void daemon_def(Daemon* d, const char* name, FILE* out) {
+  const size_t len = strlen(name);
+  if(!d->nslot)
+    return;
+  for(const Def* def = *def_bucket(d, name, len); def; def = def->next)
+    if(def->nlen == len && !memcmp(def->line, name, len))
+      fwrite(def->line, 1, def->len, out);
+}
+
+static void daemon_sym(Daemon* d, const char* prefix, FILE* out) {
+  const size_t len = strlen(prefix);
+  m_uint lo = 0, hi = d->nsorted;
+  while(lo < hi) {
+    const m_uint mid = (lo + hi) / 2;
+    const Def* def = d->sorted[mid];
+    const size_t n = def->nlen < len ? def->nlen : len;
+    const int cmp = memcmp(def->line, prefix, n);
+    if(cmp < 0 || (!cmp && def->nlen < len))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  for(m_uint i = lo; i < d->nsorted && i - lo < DAEMON_SYM_MAX; i++) {
+    const Def* def = d->sorted[i];
+    if(def->nlen < len || memcmp(def->line, prefix, len))
+      break;
+    fwrite(def->line, 1, def->len, out);
+  }
+}
+
+static m_bool send_all(const int fd, const char* buf, size_t len) {
+  while(len) {
+    const ssize_t n = write(fd, buf, len);
+    if(n < 0) {
+      if(errno == EINTR)
+        continue;
+      return 0;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 1;
+}
+
+// answers the complete lines, 0 once the client is gone
+static m_bool daemon_client(Daemon* d, Client* c) {
+  const ssize_t n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len - 1);
+  char* line = c->buf, *end;
+  if(n <= 0)
+    return 0;
+  c->len += n;
+  c->buf[c->len] = '\0';
+  while((end = strchr(line, '\n'))) {
+    char* buf;
+    size_t len;
+    FILE* out = open_memstream(&buf, &len);
+    *end = '\0';
+    if(end > line && end[-1] == '\r')
+      end[-1] = '\0';
+    if(!strncmp(line, "def ", 4))
+      daemon_def(d, line + 4, out);
+    else if(!strncmp(line, "sym ", 4))
+      daemon_sym(d, line + 4, out);
+    else if(!strcmp(line, "stop"))
+      done = 1;
+    fputc('\n', out);
+    fclose(out);
+    const m_bool ok = send_all(c->fd, buf, len);
+    free(buf);
+    if(!ok)
+      return 0;
+    line = end + 1;
+  }
+  c->len -= line - c->buf;
+  memmove(c->buf, line, c->len);
+  return c->len < sizeof(c->buf) - 1;
+}
+
+static int daemon_listen(const m_str path) {
+  struct sockaddr_un addr;
+  int fd;
+  if(strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "%s: socket path too long\n", path);
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+    perror("socket");
+    return -1;
+  }
+  unlink(path);
+  if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, 16)) {
+    perror(path);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void daemon_release(Daemon* d) {
+  for(m_uint i = 0; i < d->nfile; i++) {
+    free(d->file[i].name);
+    free(d->file[i].buf);
+    free(d->file[i].def);
+  }
+  for(m_uint i = 0; i < d->nwatch; i++)
+    free(d->watch[i].prefix);
+  free(d->file);
+  free(d->fslot);
+  free(d->watch);
+  free(d->slot);
+  free(d->sorted);
+}
+
+int tag_daemon(const m_str path, Vector files, Vector dirs, TagText text, void* data) {
+  Daemon d;
+  Client client[DAEMON_CLIENTS];
+  struct pollfd fds[DAEMON_CLIENTS + 2];
+  struct sigaction sa;
+  m_uint nclient = 0;
+  const int sock = daemon_listen(path);
+  if(sock == -1)
+    return 2;
+  memset(&d, 0, sizeof(d));
+  d.text = text;
+  d.data = data;
+  if((d.ino = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+    perror("inotify");
+    close(sock);
+    unlink(path);
+    return 2;
+  }
+  def_grow(&d);
+  for(m_uint i = 0; i < vector_size(dirs); i++) {
+    const m_str dir = (m_str)vector_at(dirs, i);
+    char prefix[strlen(dir) + 2];
+    sprintf(prefix, "%s/", dir);
+    daemon_watch(&d, prefix, 1);
+  }
+  for(m_uint i = 0; i < vector_size(files); i++) {
+    const m_str name = (m_str)vector_at(files, i);
+    const char* slash = strrchr(name, '/');
+    char prefix[strlen(name) + 1];
+    const size_t len = slash ? (size_t)(slash - name + 1) : 0;
+    memcpy(prefix, name, len);
+    prefix[len] = '\0';
+    daemon_watch(&d, prefix, 0);
+    daemon_tag(&d, name);
+  }
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = daemon_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+  fprintf(stderr, "%s: %lu tags in %lu files\n", path, d.ndef, d.nfile);
+  while(!done) {
+    fds[0].fd = d.ino;
+    fds[1].fd = sock;
+    fds[0].events = fds[1].events = POLLIN;
+    for(m_uint i = 0; i < nclient; i++) {
+      fds[i + 2].fd = client[i].fd;
+      fds[i + 2].events = POLLIN;
+    }
+    if(poll(fds, nclient + 2, -1) < 0) {
+      if(errno == EINTR)
+        continue;
+      perror("poll");
+      break;
+    }
+    if(fds[0].revents & POLLIN)
+      daemon_inotify(&d);
+    for(m_uint i = nclient; i--;) {
+      if(!fds[i + 2].revents || daemon_client(&d, &client[i]))
+        continue;
+      close(client[i].fd);
+      client[i] = client[--nclient];
+    }
+    if(fds[1].revents & POLLIN) {
+      const int fd = accept(sock, NULL, NULL);
+      if(fd == -1)
+        continue;
+      if(nclient == DAEMON_CLIENTS) {
+        close(fd);
+        continue;
+      }
+      client[nclient].fd = fd;
+      client[nclient++].len = 0;
+    }
+  }
+  for(m_uint i = 0; i < nclient; i++)
+    close(client[i].fd);
+  close(d.ino);
+  close(sock);
+  unlink(path);
+  daemon_release(&d);
+  return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef TAGD_H
+#define TAGD_H
+
+#define DAEMON_CLIENTS 64
+#define DAEMON_SYM_MAX 100
+
+// tags text of one file, NULL if it does not parse
+typedef char* (*TagText)(void*, const m_str, char*, const size_t, size_t*);
+
+// keep the tags of files and of the .gw files under dirs in memory,
+// follow the edits with inotify and answer queries on a unix socket,
+// one per line, each answer ending with an empty line:
+//   def NAME     tags of NAME
+//   sym PREFIX   tags whose name starts with PREFIX
+//   stop         shut the daemon down
+int tag_daemon(const m_str, Vector, Vector, TagText, void*);
+#endif
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "map.h"
+#include "tagdeps.h"
+
+typedef struct {
+  uint32_t from, to;
+} Edge;
+
+static int str_cmp(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static uint32_t dep_id(DepGraph* g, const char* name) {
+  char** p = bsearch(&name, g->name, g->n, sizeof(char*), str_cmp);
+  return p ? (uint32_t)(p - g->name) : UINT32_MAX;
+}
+
+static int edge_cmp(const void* a, const void* b) {
+  const Edge* x = (const Edge*)a, *y = (const Edge*)b;
+  if(x->from != y->from)
+    return (x->from > y->from) - (x->from < y->from);
+  return (x->to > y->to) - (x->to < y->to);
+}
+
+// compressed rows of the edges, grouped by their from end
+static void dep_rows(const Edge* edge, const m_uint n, const m_uint nnode,
+    uint32_t** row, uint32_t** off) {
+  *off = calloc(nnode + 1, sizeof(uint32_t));
+  *row = malloc((n ? n : 1) * sizeof(uint32_t));
+  for(m_uint i = 0; i < n; i++)
+    (*off)[edge[i].from + 1]++;
+  for(m_uint i = 0; i < nnode; i++)
+    (*off)[i + 1] += (*off)[i];
+  for(m_uint i = 0; i < n; i++)
+    (*row)[i] = edge[i].to;
+}
+
+m_bool deps_load(DepGraph* g, const m_str path) {
+  FILE* file = fopen(path, "r");
+  size_t len;
+  m_uint nline = 0, n = 0;
+  memset(g, 0, sizeof(DepGraph));
+  if(!file)
+    return 0;
+  fseek(file, 0, SEEK_END);
+  len = ftell(file);
+  rewind(file);
+  g->buf = malloc(len + 1);
+  if(fread(g->buf, 1, len, file) != len) {
+    fclose(file);
+    return 0;
+  }
+  fclose(file);
+  g->buf[len] = '\0';
+  for(size_t i = 0; i < len; i++)
+    nline += g->buf[i] == '\n';
+  char** end = malloc((nline * 2 + 1) * sizeof(char*));
+  for(char* line = g->buf; *line;) {
+    char* nl = strchr(line, '\n'), *tab = strchr(line, '\t'), *tab2;
+    if(!nl)
+      break;
+    *nl = '\0';
+    if(tab && (tab2 = strchr(tab + 1, '\t'))) {
+      *tab = *tab2 = '\0';
+      end[n++] = line;
+      end[n++] = tab + 1;
+    }
+    line = nl + 1;
+  }
+  // node names, sorted and unique
+  g->name = malloc((n + 1) * sizeof(char*));
+  memcpy(g->name, end, n * sizeof(char*));
+  qsort(g->name, n, sizeof(char*), str_cmp);
+  for(m_uint i = 0; i < n; i++)
+    if(!g->n || strcmp(g->name[g->n - 1], g->name[i]))
+      g->name[g->n++] = g->name[i];
+  Edge* edge = malloc((n / 2 + 1) * sizeof(Edge));
+  for(m_uint i = 0; i < n; i += 2) {
+    edge[i / 2].from = dep_id(g, end[i + 1]);
+    edge[i / 2].to = dep_id(g, end[i]);
+  }
+  qsort(edge, n / 2, sizeof(Edge), edge_cmp);
+  dep_rows(edge, n / 2, g->n, &g->inc, &g->inc_off);
+  for(m_uint i = 0; i < n / 2; i++) {
+    const uint32_t tmp = edge[i].from;
+    edge[i].from = edge[i].to;
+    edge[i].to = tmp;
+  }
+  qsort(edge, n / 2, sizeof(Edge), edge_cmp);
+  dep_rows(edge, n / 2, g->n, &g->user, &g->user_off);
+  free(edge);
+  free(end);
+  return 1;
+}
+
+void deps_release(DepGraph* g) {
+  free(g->name);
+  free(g->inc);
+  free(g->inc_off);
+  free(g->user);
+  free(g->user_off);
+  free(g->buf);
+}
+
+// follow includes through the files left out of the order
+// until one comes back: that is a cycle
+static m_bool dep_cycle(DepGraph* g, uint32_t i, const uint32_t* left, uint8_t* seen) {
+  uint32_t* path = malloc(g->n * sizeof(uint32_t));
+  m_uint n = 0;
+  while(!seen[i]) {
+    seen[i] = 1;
+    path[n++] = i;
+    for(uint32_t j = g->inc_off[i]; j < g->inc_off[i + 1]; j++)
+      if(left[g->inc[j]]) {
+        i = g->inc[j];
+        break;
+      }
+  }
+  m_uint start = n;
+  while(start && path[start - 1] != i)
+    start--;
+  if(start) {
+    fprintf(stderr, "include cycle:");
+    for(m_uint j = start - 1; j < n; j++)
+      fprintf(stderr, " %s ->", g->name[path[j]]);
+    fprintf(stderr, " %s\n", g->name[i]);
+  }
+  free(path);
+  return start ? 1 : 0;
+}
+
+m_uint deps_order(DepGraph* g, FILE* out) {
+  uint32_t* left = malloc((g->n + 1) * sizeof(uint32_t));
+  uint32_t* queue = malloc((g->n + 1) * sizeof(uint32_t));
+  uint8_t* seen = calloc(g->n + 1, 1);
+  m_uint head = 0, tail = 0, ncycle = 0;
+  for(m_uint i = 0; i < g->n; i++)
+    if(!(left[i] = g->inc_off[i + 1] - g->inc_off[i]))
+      queue[tail++] = i;
+  while(head < tail) {
+    const uint32_t i = queue[head++];
+    if(out)
+      fprintf(out, "%s\n", g->name[i]);
+    for(uint32_t j = g->user_off[i]; j < g->user_off[i + 1]; j++)
+      if(!--left[g->user[j]])
+        queue[tail++] = g->user[j];
+  }
+  for(m_uint i = 0; i < g->n; i++)
+    if(left[i] && !seen[i])
+      ncycle += dep_cycle(g, i, left, seen);
+  for(m_uint i = 0; out && i < g->n; i++)
+    if(left[i])
+      fprintf(out, "%s\n", g->name[i]);
+  free(left);
+  free(queue);
+  free(seen);
+  return ncycle;
+}
+
+m_bool deps_users(DepGraph* g, const m_str name, FILE* out) {
+  const uint32_t id = dep_id(g, name);
+  if(id == UINT32_MAX)
+    return 0;
+  uint32_t* queue = malloc(g->n * sizeof(uint32_t));
+  uint8_t* seen = calloc(g->n, 1);
+  m_uint head = 0, tail = 0;
+  queue[tail++] = id;
+  seen[id] = 1;
+  while(head < tail) {
+    const uint32_t i = queue[head++];
+    for(uint32_t j = g->user_off[i]; j < g->user_off[i + 1]; j++)
+      if(!seen[g->user[j]]) {
+        seen[g->user[j]] = 1;
+        queue[tail++] = g->user[j];
+        fprintf(out, "%s\n", g->name[g->user[j]]);
+      }
+  }
+  free(queue);
+  free(seen);
+  return tail > 1;
+}
@@ -0,0 +1,22 @@
+#ifndef TAGDEPS_H
+#define TAGDEPS_H
+
+// the include graph is written as "included\tincluder\tline" lines:
+// keyed on the includer, they sort, splice and drop like tags do.
+typedef struct {
+  char**    name;
+  m_uint    n;
+  uint32_t* inc;  // what a file includes, from inc[inc_off[i]]
+  uint32_t* inc_off;
+  uint32_t* user; // who includes a file, from user[user_off[i]]
+  uint32_t* user_off;
+  char*     buf;
+} DepGraph;
+
+m_bool deps_load(DepGraph*, const m_str);
+void deps_release(DepGraph*);
+// includes first, then their includers; cycles go to stderr
+m_uint deps_order(DepGraph*, FILE*);
+// every file that includes name, directly or not
+m_bool deps_users(DepGraph*, const m_str, FILE*);
+#endif
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "defs.h"
+#include "map.h"
+#include "tagfile.h"
+
+typedef struct {
+  FILE* file;
+  char* line;
+  size_t cap;
+  m_bool filter;
+} Run;
+
+static int str_cmp(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void sort_lines(TagSort* sort) {
+  qsort(sort->lines, sort->n, sizeof(char*), str_cmp);
+}
+
+static void sort_spill(TagSort* sort) {
+  FILE* run = tmpfile();
+  sort_lines(sort);
+  for(m_uint i = 0; i < sort->n; i++) {
+    fputs(sort->lines[i], run);
+    free(sort->lines[i]);
+  }
+  sort->n = 0;
+  sort->size = 0;
+  rewind(run);
+  vector_add(sort->runs, (vtype)run);
+}
+
+void sort_add(TagSort* sort, const char* buf, size_t len) {
+  const char* end = buf + len;
+  while(buf < end) {
+    const char* nl = memchr(buf, '\n', end - buf);
+    const size_t sz = (nl ? nl + 1 : end) - buf;
+    if(sort->n == sort->cap) {
+      sort->cap = sort->cap ? sort->cap * 2 : 1024;
+      sort->lines = realloc(sort->lines, sort->cap * sizeof(char*));
+    }
+    sort->lines[sort->n++] = strndup(buf, sz);
+    sort->size += sz;
+    buf += sz;
+  }
+  if(sort->size > RUN_SIZE)
+    sort_spill(sort);
+}
+
+// entries from this file in a spliced tags file are stale
+void sort_drop(TagSort* sort, const m_str name) {
+  sort->drop = realloc(sort->drop, (sort->ndrop + 1) * sizeof(char*));
+  sort->drop[sort->ndrop++] = strdup(name);
+  sort->sorted = 0;
+}
+
+m_bool sort_dropped(TagSort* sort, const char* file) {
+  if(!sort->sorted) {
+    qsort(sort->drop, sort->ndrop, sizeof(char*), str_cmp);
+    sort->sorted = 1;
+  }
+  return bsearch(&file, sort->drop, sort->ndrop, sizeof(char*), str_cmp) != NULL;
+}
+
+// merge an existing sorted tags file, minus its header and dropped files
+m_bool sort_splice(TagSort* sort, const m_str name) {
+  FILE* file = fopen(name, "r");
+  if(!file)
+    return 0;
+  sort->splice = file;
+  return 1;
+}
+
+static m_bool run_skip(TagSort* sort, Run* run) {
+  char* tab, *end;
+  if(*run->line == '!')
+    return 1;
+  if(!(tab = strchr(run->line, '\t')) || !(end = strchr(tab + 1, '\t')))
+    return 1;
+  *end = '\0';
+  const m_bool ret = sort_dropped(sort, tab + 1);
+  *end = '\t';
+  return ret;
+}
+
+static m_bool run_next(TagSort* sort, Run* run) {
+  while(getline(&run->line, &run->cap, run->file) != -1)
+    if(!run->filter || !run_skip(sort, run))
+      return 1;
+  fclose(run->file);
+  run->file = NULL;
+  return 0;
+}
+
+static void sort_header(FILE* file) {
+  fprintf(file, "!_TAG_FILE_FORMAT\t2\t/extended format/\n");
+  fprintf(file, "!_TAG_FILE_SORTED\t1\t/0=unsorted, 1=sorted, 2=foldcase/\n");
+  fprintf(file, "!_TAG_PROGRAM_NAME\tgwtag\t//\n");
+}
+
+// k-way merge of the sorted runs, dropping duplicate lines
+static void sort_merge(TagSort* sort, FILE* file) {
+  const m_uint n = vector_size(sort->runs) + !!sort->splice;
+  Run* run = calloc(n, sizeof(Run));
+  char* last = NULL;
+  for(m_uint i = 0; i < vector_size(sort->runs); i++)
+    run[i].file = (FILE*)vector_at(sort->runs, i);
+  if(sort->splice) {
+    run[n - 1].file = sort->splice;
+    run[n - 1].filter = 1;
+    sort->splice = NULL;
+  }
+  for(m_uint i = 0; i < n; i++)
+    run_next(sort, &run[i]);
+  while(1) {
+    Run* min = NULL;
+    for(m_uint i = 0; i < n; i++)
+      if(run[i].file && (!min || strcmp(run[i].line, min->line) < 0))
+        min = &run[i];
+    if(!min)
+      break;
+    if(!last || strcmp(last, min->line))
+      fputs(min->line, file);
+    free(last);
+    last = strdup(min->line);
+    run_next(sort, min);
+  }
+  free(last);
+  for(m_uint i = 0; i < n; i++)
+    free(run[i].line);
+  free(run);
+}
+
+// an already sorted run, e.g. from a worker
+void sort_run(TagSort* sort, FILE* file) {
+  vector_add(sort->runs, (vtype)file);
+}
+
+void sort_flush(TagSort* sort, FILE* file) {
+  if(vector_size(sort->runs) || sort->splice) {
+    if(sort->n)
+      sort_spill(sort);
+    sort_merge(sort, file);
+    return;
+  }
+  sort_lines(sort);
+  for(m_uint i = 0; i < sort->n; i++)
+    if(!i || strcmp(sort->lines[i], sort->lines[i - 1]))
+      fputs(sort->lines[i], file);
+}
+
+void sort_write(TagSort* sort, FILE* file) {
+  sort_header(file);
+  sort_flush(sort, file);
+}
+
+TagSort* new_sort(void) {
+  TagSort* sort = calloc(1, sizeof(TagSort));
+  sort->runs = new_vector();
+  return sort;
+}
+
+void free_sort(TagSort* sort) {
+  for(m_uint i = 0; i < sort->n; i++)
+    free(sort->lines[i]);
+  for(m_uint i = 0; i < sort->ndrop; i++)
+    free(sort->drop[i]);
+  free(sort->lines);
+  free(sort->drop);
+  free_vector(sort->runs);
+  free(sort);
+}
+
+// FNV-1a
+uint64_t tag_hash(const char* buf, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  while(len--) {
+    hash ^= (unsigned char)*buf++;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static int stamp_cmp(const void* a, const void* b) {
+  return strcmp(((const Stamp*)a)->path, ((const Stamp*)b)->path);
+}
+
+static Stamp* manifest_new(Manifest* m) {
+  if(m->n == m->cap) {
+    m->cap = m->cap ? m->cap * 2 : 256;
+    m->stamp = realloc(m->stamp, m->cap * sizeof(Stamp));
+  }
+  Stamp* stamp = &m->stamp[m->n++];
+  memset(stamp, 0, sizeof(Stamp));
+  return stamp;
+}
+
+// one "mtime size hash/shape path" line per file, sorted by path.
+// older manifests have no shape.
+void manifest_load(Manifest* m, const m_str name) {
+  FILE* file = fopen(name, "r");
+  char* line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  if(!file)
+    return;
+  while((len = getline(&line, &cap, file)) != -1) {
+    long long mtime, size;
+    uint64_t hash, shape = 0;
+    int off;
+    if(line[len - 1] == '\n')
+      line[len - 1] = '\0';
+    if(sscanf(line, "%lld %lld %" SCNx64 "%n", &mtime, &size, &hash, &off) != 3)
+      continue;
+    if(line[off] == '/') {
+      int n;
+      if(sscanf(line + off + 1, "%" SCNx64 "%n", &shape, &n) != 1)
+        continue;
+      off += n + 1;
+    }
+    off += strspn(line + off, " ");
+    Stamp* stamp = manifest_new(m);
+    stamp->path = strdup(line + off);
+    stamp->mtime = mtime;
+    stamp->size = size;
+    stamp->hash = hash;
+    stamp->shape = shape;
+  }
+  free(line);
+  fclose(file);
+  qsort(m->stamp, m->n, sizeof(Stamp), stamp_cmp);
+  m->sorted = m->n;
+}
+
+Stamp* manifest_find(Manifest* m, const m_str path) {
+  const Stamp key = { .path = path };
+  return bsearch(&key, m->stamp, m->sorted, sizeof(Stamp), stamp_cmp);
+}
+
+// new entries go past the sorted part and are not found
+// by manifest_find() until the manifest is written out
+Stamp* manifest_add(Manifest* m, const m_str path) {
+  Stamp* stamp = manifest_new(m);
+  stamp->path = strdup(path);
+  stamp->seen = 1;
+  return stamp;
+}
+
+m_bool manifest_write(Manifest* m, const m_str name) {
+  FILE* file = fopen(name, "w");
+  if(!file)
+    return 0;
+  qsort(m->stamp, m->n, sizeof(Stamp), stamp_cmp);
+  m->sorted = m->n;
+  for(m_uint i = 0; i < m->n; i++)
+    if(m->stamp[i].seen)
+      fprintf(file, "%lld %lld %016" PRIx64 "/%016" PRIx64 " %s\n",
+          (long long)m->stamp[i].mtime, (long long)m->stamp[i].size,
+          m->stamp[i].hash, m->stamp[i].shape, m->stamp[i].path);
+  fclose(file);
+  return 1;
+}
+
+void manifest_release(Manifest* m) {
+  for(m_uint i = 0; i < m->n; i++)
+    free(m->stamp[i].path);
+  free(m->stamp);
+}
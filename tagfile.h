@@ -0,0 +1,50 @@
+#ifndef TAGFILE_H
+#define TAGFILE_H
+#include <stdint.h>
+#include <sys/types.h>
+
+#define RUN_SIZE (64 << 20)
+
+typedef struct {
+  char** lines;
+  m_uint n, cap;
+  Vector runs;
+  size_t size;
+  char** drop;
+  m_uint ndrop;
+  m_bool sorted;
+  FILE* splice;
+} TagSort;
+
+typedef struct {
+  m_str    path;
+  time_t   mtime;
+  off_t    size;
+  uint64_t hash;
+  uint64_t shape;  // of what the tool made of it: equal for an edit it ignores
+  m_bool   seen;
+} Stamp;
+
+typedef struct {
+  Stamp* stamp;
+  m_uint n, cap;
+  m_uint sorted;
+} Manifest;
+
+TagSort* new_sort(void);
+void free_sort(TagSort*);
+void sort_add(TagSort*, const char*, size_t);
+void sort_drop(TagSort*, const m_str);
+m_bool sort_dropped(TagSort*, const char*);
+m_bool sort_splice(TagSort*, const m_str);
+void sort_run(TagSort*, FILE*);
+void sort_flush(TagSort*, FILE*);
+void sort_write(TagSort*, FILE*);
+
+uint64_t tag_hash(const char*, size_t);
+void manifest_load(Manifest*, const m_str);
+Stamp* manifest_find(Manifest*, const m_str);
+Stamp* manifest_add(Manifest*, const m_str);
+m_bool manifest_write(Manifest*, const m_str);
+void manifest_release(Manifest*);
+#endif
@@ -0,0 +1,461 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "defs.h"
+#include "map.h"
+#include "tagfile.h"
+#include "tagindex.h"
+
+typedef struct {
+  char*     pool;
+  uint32_t  size, cap;
+  uint32_t* slot;
+  uint32_t* val;
+  uint32_t  nslot, used;
+} Intern;
+
+typedef struct {
+  IndexRec* rec;
+  uint32_t  nrec, cap;
+  uint32_t* file;
+  uint32_t  nfile;
+  Intern    str;
+  Intern    path;
+} Builder;
+
+static uint32_t str_hash(const char* str) {
+  return (uint32_t)tag_hash(str, strlen(str));
+}
+
+static uint32_t slot_count(const uint32_t n) {
+  uint32_t nslot = 16;
+  while(nslot < n * 2)
+    nslot *= 2;
+  return nslot;
+}
+
+static void intern_grow(Intern* in) {
+  uint32_t* slot = in->slot, *val = in->val;
+  const uint32_t n = in->nslot;
+  in->nslot = n ? n * 2 : 1024;
+  in->slot = calloc(in->nslot, sizeof(uint32_t));
+  in->val = calloc(in->nslot, sizeof(uint32_t));
+  for(uint32_t i = 0; i < n; i++) {
+    if(!slot[i])
+      continue;
+    uint32_t h = str_hash(in->pool + slot[i] - 1) & (in->nslot - 1);
+    while(in->slot[h])
+      h = (h + 1) & (in->nslot - 1);
+    in->slot[h] = slot[i];
+    in->val[h] = val[i];
+  }
+  free(slot);
+  free(val);
+}
+
+// slot of str, which is added to the pool with val set to UINT32_MAX if new
+static uint32_t intern_slot(Intern* in, const char* str) {
+  if(in->used * 2 >= in->nslot)
+    intern_grow(in);
+  uint32_t h = str_hash(str) & (in->nslot - 1);
+  while(in->slot[h]) {
+    if(!strcmp(in->pool + in->slot[h] - 1, str))
+      return h;
+    h = (h + 1) & (in->nslot - 1);
+  }
+  const uint32_t len = strlen(str) + 1;
+  while(in->size + len > in->cap) {
+    in->cap = in->cap ? in->cap * 2 : 4096;
+    in->pool = realloc(in->pool, in->cap);
+  }
+  memcpy(in->pool + in->size, str, len);
+  in->slot[h] = in->size + 1;
+  in->val[h] = UINT32_MAX;
+  in->used++;
+  in->size += len;
+  return h;
+}
+
+static uint32_t intern(Intern* in, const char* str) {
+  const uint32_t h = intern_slot(in, str);
+  return in->slot[h] - 1;
+}
+
+static uint32_t builder_file(Builder* b, const char* name) {
+  const uint32_t h = intern_slot(&b->path, name);
+  if(b->path.val[h] == UINT32_MAX) {
+    b->file = realloc(b->file, (b->nfile + 1) * sizeof(uint32_t));
+    b->file[b->nfile] = intern(&b->str, name);
+    b->path.val[h] = b->nfile++;
+  }
+  return b->path.val[h];
+}
+
+static IndexRec* builder_rec(Builder* b) {
+  if(b->nrec == b->cap) {
+    b->cap = b->cap ? b->cap * 2 : 1024;
+    b->rec = realloc(b->rec, b->cap * sizeof(IndexRec));
+  }
+  IndexRec* rec = &b->rec[b->nrec++];
+  memset(rec, 0, sizeof(IndexRec));
+  return rec;
+}
+
+// name<TAB>file<TAB>line;"<TAB>kind[<TAB>field:value...]
+static m_bool builder_line(Builder* b, char* line) {
+  char* field[16];
+  m_uint n = 0;
+  char* save;
+  if(*line == '!')
+    return 1;
+  line[strcspn(line, "\n")] = '\0';
+  for(char* tok = strtok_r(line, "\t", &save); tok && n < 16;
+      tok = strtok_r(NULL, "\t", &save))
+    field[n++] = tok;
+  if(n < 4)
+    return 0;
+  IndexRec* rec = builder_rec(b);
+  rec->name = intern(&b->str, field[0]);
+  rec->file = builder_file(b, field[1]);
+  rec->line = strtoul(field[2], NULL, 10);
+  rec->kind = *field[3];
+  rec->cls = UINT32_MAX;
+  for(m_uint i = 4; i < n; i++)
+    if(!strncmp(field[i], "class:", 6))
+      rec->cls = intern(&b->str, field[i] + 6);
+  return 1;
+}
+
+static uint32_t* builder_slots(Builder* b, uint32_t* nslot) {
+  uint32_t uniq = 0;
+  for(uint32_t i = 0; i < b->nrec; i++)
+    if(!i || strcmp(b->str.pool + b->rec[i].name, b->str.pool + b->rec[i - 1].name))
+      uniq++;
+  *nslot = slot_count(uniq);
+  uint32_t* slot = calloc(*nslot, sizeof(uint32_t));
+  for(uint32_t i = 0; i < b->nrec; i++) {
+    const char* name = b->str.pool + b->rec[i].name;
+    if(i && !strcmp(name, b->str.pool + b->rec[i - 1].name))
+      continue;
+    uint32_t h = str_hash(name) & (*nslot - 1);
+    while(slot[h])
+      h = (h + 1) & (*nslot - 1);
+    slot[h] = i + 1;
+  }
+  return slot;
+}
+
+static int u64_cmp(const void* a, const void* b) {
+  const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t tri_key(const char* str) {
+  return (uint32_t)tolower((unsigned char)str[0]) << 16 |
+    (uint32_t)tolower((unsigned char)str[1]) << 8 |
+    (uint32_t)tolower((unsigned char)str[2]);
+}
+
+// (trigram, first record of the name) pairs, sorted and deduplicated
+static IndexTri* builder_tri(Builder* b, uint32_t* ntri, uint32_t** post, uint32_t* npost) {
+  uint64_t* pair = NULL;
+  size_t n = 0, cap = 0;
+  for(uint32_t i = 0; i < b->nrec; i++) {
+    const char* name = b->str.pool + b->rec[i].name;
+    if(i && !strcmp(name, b->str.pool + b->rec[i - 1].name))
+      continue;
+    for(const char* c = name; c[0] && c[1] && c[2]; c++) {
+      if(n == cap) {
+        cap = cap ? cap * 2 : 4096;
+        pair = realloc(pair, cap * sizeof(uint64_t));
+      }
+      pair[n++] = (uint64_t)tri_key(c) << 32 | i;
+    }
+  }
+  qsort(pair, n, sizeof(uint64_t), u64_cmp);
+  IndexTri* tri = NULL;
+  *ntri = *npost = 0;
+  *post = malloc((n + 1) * sizeof(uint32_t));
+  for(size_t i = 0; i < n; i++) {
+    if(i && pair[i] == pair[i - 1])
+      continue;
+    const uint32_t key = pair[i] >> 32;
+    if(!*ntri || tri[*ntri - 1].key != key) {
+      tri = realloc(tri, (*ntri + 1) * sizeof(IndexTri));
+      tri[*ntri].key = key;
+      tri[*ntri].off = *npost;
+      tri[*ntri].n = 0;
+      ++*ntri;
+    }
+    (*post)[(*npost)++] = (uint32_t)pair[i];
+    tri[*ntri - 1].n++;
+  }
+  free(pair);
+  return tri;
+}
+
+static void builder_release(Builder* b) {
+  free(b->rec);
+  free(b->file);
+  free(b->str.pool);
+  free(b->str.slot);
+  free(b->str.val);
+  free(b->path.pool);
+  free(b->path.slot);
+  free(b->path.val);
+}
+
+// build from a sorted tags file
+m_bool index_build(const m_str tags, const m_str name, const m_bool trigram) {
+  Builder b;
+  IndexHeader head = { INDEX_MAGIC, INDEX_VERSION, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+  IndexTri* tri = NULL;
+  uint32_t* post = NULL, npost = 0;
+  char* line = NULL;
+  size_t cap = 0;
+  FILE* in = fopen(tags, "r"), *out;
+  char tmp[strlen(name) + 5];
+  if(!in) {
+    perror(tags);
+    return 0;
+  }
+  memset(&b, 0, sizeof(Builder));
+  while(getline(&line, &cap, in) != -1)
+    builder_line(&b, line);
+  free(line);
+  fclose(in);
+  uint32_t* slot = builder_slots(&b, &head.nslot);
+  if(trigram)
+    tri = builder_tri(&b, &head.ntri, &post, &npost);
+  head.nrec = b.nrec;
+  head.nfile = b.nfile;
+  head.rec = sizeof(IndexHeader);
+  head.file = head.rec + b.nrec * sizeof(IndexRec);
+  head.slot = head.file + b.nfile * sizeof(uint32_t);
+  head.pool = head.slot + head.nslot * sizeof(uint32_t);
+  head.tri = head.pool + ((b.str.size + 3) & ~3U);
+  head.post = head.tri + head.ntri * sizeof(IndexTri);
+  head.size = head.post + npost * sizeof(uint32_t);
+  sprintf(tmp, "%s.tmp", name);
+  if((out = fopen(tmp, "w"))) {
+    fwrite(&head, sizeof(IndexHeader), 1, out);
+    fwrite(b.rec, sizeof(IndexRec), b.nrec, out);
+    fwrite(b.file, sizeof(uint32_t), b.nfile, out);
+    fwrite(slot, sizeof(uint32_t), head.nslot, out);
+    fwrite(b.str.pool, 1, b.str.size, out);
+    fwrite("\0\0\0", 1, head.tri - head.pool - b.str.size, out);
+    fwrite(tri, sizeof(IndexTri), head.ntri, out);
+    fwrite(post, sizeof(uint32_t), npost, out);
+    fclose(out);
+    if(rename(tmp, name))
+      perror(name);
+  } else
+    perror(tmp);
+  free(slot);
+  free(tri);
+  free(post);
+  builder_release(&b);
+  return out != NULL;
+}
+
+m_bool index_open(Index* idx, const m_str name) {
+  struct stat st;
+  const int fd = open(name, O_RDONLY);
+  void* map;
+  if(fd == -1)
+    return 0;
+  if(fstat(fd, &st) || (size_t)st.st_size < sizeof(IndexHeader) ||
+      (map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return 0;
+  }
+  close(fd);
+  const IndexHeader* head = map;
+  if(memcmp(head->magic, INDEX_MAGIC, 4) || head->version != INDEX_VERSION ||
+      head->size != st.st_size) {
+    munmap(map, st.st_size);
+    return 0;
+  }
+  idx->head = head;
+  idx->rec = (const IndexRec*)((const char*)map + head->rec);
+  idx->file = (const uint32_t*)((const char*)map + head->file);
+  idx->slot = (const uint32_t*)((const char*)map + head->slot);
+  idx->pool = (const char*)map + head->pool;
+  idx->tri = (const IndexTri*)((const char*)map + head->tri);
+  idx->post = (const uint32_t*)((const char*)map + head->post);
+  idx->size = st.st_size;
+  return 1;
+}
+
+void index_close(Index* idx) {
+  munmap((void*)idx->head, idx->size);
+}
+
+// records named exactly name
+const IndexRec* index_find(const Index* idx, const char* name, m_uint* n) {
+  const uint32_t mask = idx->head->nslot - 1;
+  uint32_t h = str_hash(name) & mask;
+  *n = 0;
+  while(idx->slot[h]) {
+    const uint32_t first = idx->slot[h] - 1;
+    if(!strcmp(idx->pool + idx->rec[first].name, name)) {
+      uint32_t last = first;
+      while(++last < idx->head->nrec && !strcmp(idx->pool + idx->rec[last].name, name));
+      *n = last - first;
+      return &idx->rec[first];
+    }
+    h = (h + 1) & mask;
+  }
+  return NULL;
+}
+
+// records whose name starts with prefix
+const IndexRec* index_prefix(const Index* idx, const char* prefix, m_uint* n) {
+  const size_t len = strlen(prefix);
+  uint32_t lo = 0, hi = idx->head->nrec;
+  while(lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    if(strcmp(idx->pool + idx->rec[mid].name, prefix) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  hi = lo;
+  while(hi < idx->head->nrec && !strncmp(idx->pool + idx->rec[hi].name, prefix, len))
+    hi++;
+  *n = hi - lo;
+  return *n ? &idx->rec[lo] : NULL;
+}
+
+void index_print(const Index* idx, const IndexRec* rec, FILE* file) {
+  fprintf(file, "%s\t%s\t%u\t%c", idx->pool + rec->name,
+      idx->pool + idx->file[rec->file], rec->line, rec->kind);
+  if(rec->cls != UINT32_MAX)
+    fprintf(file, "\t%s", idx->pool + rec->cls);
+  fputc('\n', file);
+}
+
+// higher is better, 0 when query is not even a subsequence of name
+static int fuzzy_score(const char* name, const char* query, const size_t len) {
+  const size_t nlen = strlen(name);
+  int score = 0;
+  size_t j = 0, gap = 0;
+  if(!strcasecmp(name, query))
+    return 1000;
+  if(!strncasecmp(name, query, len))
+    score = 800;
+  else {
+    for(size_t i = 0; i + len <= nlen; i++)
+      if(!strncasecmp(name + i, query, len)) {
+        score = 600 - (int)i;
+        break;
+      }
+  }
+  if(!score) {
+    for(size_t i = 0; i < nlen && j < len; i++) {
+      if(tolower((unsigned char)name[i]) == query[j])
+        j++;
+      else if(j)
+        gap++;
+    }
+    if(j < len)
+      return 0;
+    score = 300 - (int)gap;
+  }
+  return score - (int)(nlen - len);
+}
+
+static int hit_cmp(const void* a, const void* b) {
+  const IndexHit* x = a, *y = b;
+  if(x->score != y->score)
+    return y->score - x->score;
+  return (x->rec > y->rec) - (x->rec < y->rec);
+}
+
+static void search_add(IndexHit** hit, m_uint* n, m_uint* cap, const uint32_t rec, const int score) {
+  if(*n == *cap) {
+    *cap = *cap ? *cap * 2 : 64;
+    *hit = realloc(*hit, *cap * sizeof(IndexHit));
+  }
+  (*hit)[*n].rec = rec;
+  (*hit)[*n].score = score;
+  ++*n;
+}
+
+static const IndexTri* tri_find(const Index* idx, const uint32_t key) {
+  uint32_t lo = 0, hi = idx->head->ntri;
+  while(lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    if(idx->tri[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < idx->head->ntri && idx->tri[lo].key == key ? &idx->tri[lo] : NULL;
+}
+
+// names sharing most of the query's trigrams, ranked by fuzzy score.
+// short queries, or an index built without trigrams, scan every name.
+IndexHit* index_search(const Index* idx, const char* str, m_uint* n) {
+  const size_t len = strlen(str);
+  char query[len + 1];
+  IndexHit* hit = NULL;
+  m_uint cap = 0;
+  *n = 0;
+  for(size_t i = 0; i <= len; i++)
+    query[i] = tolower((unsigned char)str[i]);
+  if(!len)
+    return NULL;
+  if(len < 3 || !idx->head->ntri) {
+    for(uint32_t i = 0; i < idx->head->nrec; i++) {
+      const char* name = idx->pool + idx->rec[i].name;
+      if(i && idx->rec[i].name == idx->rec[i - 1].name)
+        continue;
+      const int score = fuzzy_score(name, query, len);
+      if(score > 0)
+        search_add(&hit, n, &cap, i, score);
+    }
+  } else {
+    const IndexTri* list[len];
+    uint32_t pos[len];
+    m_uint nlist = 0, nkey = 0;
+    for(size_t i = 0; i + 2 < len; i++) {
+      const uint32_t key = tri_key(query + i);
+      m_bool dup = 0;
+      for(size_t j = 0; j < i; j++)
+        if(tri_key(query + j) == key)
+          dup = 1;
+      if(dup)
+        continue;
+      nkey++;
+      if((list[nlist] = tri_find(idx, key)))
+        pos[nlist++] = 0;
+    }
+    const m_uint need = nkey - nkey / 3;
+    while(1) {
+      uint32_t min = UINT32_MAX;
+      m_uint count = 0;
+      for(m_uint i = 0; i < nlist; i++)
+        if(pos[i] < list[i]->n && idx->post[list[i]->off + pos[i]] < min)
+          min = idx->post[list[i]->off + pos[i]];
+      if(min == UINT32_MAX)
+        break;
+      for(m_uint i = 0; i < nlist; i++)
+        if(pos[i] < list[i]->n && idx->post[list[i]->off + pos[i]] == min) {
+          pos[i]++;
+          count++;
+        }
+      if(count < need)
+        continue;
+      const int score = fuzzy_score(idx->pool + idx->rec[min].name, query, len);
+      search_add(&hit, n, &cap, min, score + (int)(count * 100 / nkey));
+    }
+  }
+  qsort(hit, *n, sizeof(IndexHit), hit_cmp);
+  return hit;
+}
@@ -0,0 +1,56 @@
+#ifndef TAGINDEX_H
+#define TAGINDEX_H
+#include <stdint.h>
+
+#define INDEX_MAGIC "GWTI"
+#define INDEX_VERSION 2
+
+// all offsets are from the start of the file, strings are offsets in the pool
+typedef struct {
+  char     magic[4];
+  uint32_t version;
+  uint32_t nrec, nfile, nslot, ntri;
+  uint32_t rec, file, slot, pool, tri, post;
+  uint32_t size;
+} IndexHeader;
+
+// sorted by name, so every symbol is one contiguous range
+typedef struct {
+  uint32_t name;
+  uint32_t cls;
+  uint32_t file;
+  uint32_t line;
+  char     kind;
+} IndexRec;
+
+// the lower cased trigram in the low 24 bits, and where its
+// posting list, the first record of each name containing it, is
+typedef struct {
+  uint32_t key;
+  uint32_t off, n;
+} IndexTri;
+
+typedef struct {
+  uint32_t rec;
+  int      score;
+} IndexHit;
+
+typedef struct {
+  const IndexHeader* head;
+  const IndexRec*    rec;
+  const uint32_t*    file;
+  const uint32_t*    slot;
+  const char*        pool;
+  const IndexTri*    tri;
+  const uint32_t*    post;
+  size_t             size;
+} Index;
+
+m_bool index_build(const m_str, const m_str, const m_bool);
+m_bool index_open(Index*, const m_str);
+void index_close(Index*);
+const IndexRec* index_find(const Index*, const char*, m_uint*);
+const IndexRec* index_prefix(const Index*, const char*, m_uint*);
+IndexHit* index_search(const Index*, const char*, m_uint*);
+void index_print(const Index*, const IndexRec*, FILE*);
+#endif
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "defs.h"
+#include "map.h"
+#include "tagfile.h"
+#include "tagref.h"
+
+typedef struct {
+  uint8_t* ptr;
+  size_t   len, cap;
+} Bytes;
+
+typedef struct {
+  const RefHeader* head;
+  const RefSym*    sym;
+  const uint32_t*  file;
+  const char*      pool;
+  const uint8_t*   data;
+  size_t           size;
+} Refs;
+
+static void bytes_grow(Bytes* b, const size_t len) {
+  while(b->len + len > b->cap) {
+    b->cap = b->cap ? b->cap * 2 : 4096;
+    b->ptr = realloc(b->ptr, b->cap);
+  }
+}
+
+static uint32_t bytes_str(Bytes* b, const char* str) {
+  const size_t len = strlen(str) + 1;
+  const uint32_t off = b->len;
+  bytes_grow(b, len);
+  memcpy(b->ptr + b->len, str, len);
+  b->len += len;
+  return off;
+}
+
+static void varint(Bytes* b, uint32_t v) {
+  bytes_grow(b, 5);
+  while(v >= 0x80) {
+    b->ptr[b->len++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  b->ptr[b->len++] = v;
+}
+
+static uint32_t varint_read(const uint8_t** p) {
+  uint32_t v = 0;
+  for(int shift = 0; ; shift += 7) {
+    const uint8_t c = *(*p)++;
+    v |= (uint32_t)(c & 0x7f) << shift;
+    if(!(c & 0x80))
+      return v;
+  }
+}
+
+// name<TAB>file<TAB>line in hex<TAB>kind
+static m_bool ref_split(char* line, char** field) {
+  line[strcspn(line, "\n")] = '\0';
+  field[0] = line;
+  for(int i = 1; i < 4; i++) {
+    if(!(field[i] = strchr(field[i - 1], '\t')))
+      return 0;
+    *field[i]++ = '\0';
+  }
+  return 1;
+}
+
+static int str_cmp(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static uint32_t file_id(char** file, const uint32_t n, const char* name) {
+  char** found = bsearch(&name, file, n, sizeof(char*), str_cmp);
+  return found - file;
+}
+
+typedef struct {
+  uint32_t* ref;
+  uint32_t  n, cap;
+  uint32_t  file, prev;
+} Group;
+
+// the references of one symbol in one file
+static void group_flush(Group* g, Bytes* data) {
+  uint32_t line = 0;
+  if(!g->n)
+    return;
+  varint(data, g->file - g->prev);
+  varint(data, g->n);
+  for(uint32_t i = 0; i < g->n; i++) {
+    varint(data, ((g->ref[i] >> 2) - line) << 2 | (g->ref[i] & 3));
+    line = g->ref[i] >> 2;
+  }
+  g->prev = g->file;
+  g->n = 0;
+}
+
+static void group_add(Group* g, const uint32_t line, const uint32_t kind) {
+  if(g->n == g->cap) {
+    g->cap = g->cap ? g->cap * 2 : 64;
+    g->ref = realloc(g->ref, g->cap * sizeof(uint32_t));
+  }
+  g->ref[g->n++] = line << 2 | kind;
+}
+
+// two passes over the sorted lines:
+// one to number the files in path order, one to encode
+m_bool ref_build(FILE* in, const m_str name) {
+  RefHeader head = { REF_MAGIC, REF_VERSION, 0, 0, 0, 0, 0, 0, 0 };
+  Bytes pool = { NULL, 0, 0 }, data = { NULL, 0, 0 };
+  Group g = { NULL, 0, 0, 0, 0 };
+  RefSym* sym = NULL;
+  char** file = NULL;
+  char* line = NULL, *field[4], *last = NULL;
+  size_t cap = 0;
+  uint32_t nfile = 0, fcap = 0, scap = 0;
+  FILE* out;
+  char tmp[strlen(name) + 5];
+  while(getline(&line, &cap, in) != -1) {
+    if(!ref_split(line, field))
+      continue;
+    if(nfile && !strcmp(file[nfile - 1], field[1]))
+      continue;
+    if(nfile == fcap) {
+      fcap = fcap ? fcap * 2 : 256;
+      file = realloc(file, fcap * sizeof(char*));
+    }
+    file[nfile++] = strdup(field[1]);
+  }
+  qsort(file, nfile, sizeof(char*), str_cmp);
+  uint32_t j = 0;
+  for(uint32_t i = 0; i < nfile; i++) {
+    if(j && !strcmp(file[i], file[j - 1]))
+      free(file[i]);
+    else
+      file[j++] = file[i];
+  }
+  nfile = j;
+  uint32_t* file_off = malloc((nfile + 1) * sizeof(uint32_t));
+  for(uint32_t i = 0; i < nfile; i++)
+    file_off[i] = bytes_str(&pool, file[i]);
+  rewind(in);
+  while(getline(&line, &cap, in) != -1) {
+    if(!ref_split(line, field))
+      continue;
+    const uint32_t id = file_id(file, nfile, field[1]);
+    const char* kind = strchr(REF_KINDS, *field[3]);
+    if(!last || strcmp(last, field[0])) {
+      group_flush(&g, &data);
+      if(head.nsym == scap) {
+        scap = scap ? scap * 2 : 1024;
+        sym = realloc(sym, scap * sizeof(RefSym));
+      }
+      sym[head.nsym].name = bytes_str(&pool, field[0]);
+      sym[head.nsym].data = data.len;
+      sym[head.nsym].n = 0;
+      head.nsym++;
+      free(last);
+      last = strdup(field[0]);
+      g.file = id;
+      g.prev = 0;
+    } else if(id != g.file) {
+      group_flush(&g, &data);
+      g.file = id;
+    }
+    group_add(&g, strtoul(field[2], NULL, 16),
+        kind && *kind ? kind - REF_KINDS : ref_use);
+    sym[head.nsym - 1].n++;
+  }
+  group_flush(&g, &data);
+  free(g.ref);
+  free(line);
+  free(last);
+  for(uint32_t i = 0; i < nfile; i++)
+    free(file[i]);
+  free(file);
+  head.nfile = nfile;
+  head.sym = sizeof(RefHeader);
+  head.file = head.sym + head.nsym * sizeof(RefSym);
+  head.pool = head.file + nfile * sizeof(uint32_t);
+  head.data = head.pool + pool.len;
+  head.size = head.data + data.len;
+  sprintf(tmp, "%s.tmp", name);
+  if((out = fopen(tmp, "w"))) {
+    fwrite(&head, sizeof(RefHeader), 1, out);
+    fwrite(sym, sizeof(RefSym), head.nsym, out);
+    fwrite(file_off, sizeof(uint32_t), nfile, out);
+    fwrite(pool.ptr, 1, pool.len, out);
+    fwrite(data.ptr, 1, data.len, out);
+    fclose(out);
+    if(rename(tmp, name))
+      perror(name);
+  } else
+    perror(tmp);
+  free(file_off);
+  free(sym);
+  free(pool.ptr);
+  free(data.ptr);
+  return out != NULL;
+}
+
+static m_bool refs_open(Refs* refs, const m_str name) {
+  struct stat st;
+  const int fd = open(name, O_RDONLY);
+  void* map;
+  if(fd == -1)
+    return 0;
+  if(fstat(fd, &st) || (size_t)st.st_size < sizeof(RefHeader) ||
+      (map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return 0;
+  }
+  close(fd);
+  const RefHeader* head = map;
+  if(memcmp(head->magic, REF_MAGIC, 4) || head->version != REF_VERSION ||
+      head->size != st.st_size) {
+    munmap(map, st.st_size);
+    return 0;
+  }
+  refs->head = head;
+  refs->sym = (const RefSym*)((const char*)map + head->sym);
+  refs->file = (const uint32_t*)((const char*)map + head->file);
+  refs->pool = (const char*)map + head->pool;
+  refs->data = (const uint8_t*)map + head->data;
+  refs->size = st.st_size;
+  return 1;
+}
+
+static void refs_close(Refs* refs) {
+  munmap((void*)refs->head, refs->size);
+}
+
+// print the references of sym as sorted lines, or as query results
+static void refs_print(const Refs* refs, const RefSym* sym, FILE* out,
+    TagSort* drop, const m_bool text) {
+  const uint8_t* p = refs->data + sym->data;
+  const char* name = refs->pool + sym->name;
+  uint32_t file = 0, left = sym->n;
+  while(left) {
+    file += varint_read(&p);
+    const uint32_t n = varint_read(&p);
+    const char* path = refs->pool + refs->file[file];
+    const m_bool skip = drop && sort_dropped(drop, path);
+    uint32_t line = 0;
+    for(uint32_t i = 0; i < n; i++) {
+      const uint32_t v = varint_read(&p);
+      line += v >> 2;
+      if(skip)
+        continue;
+      if(text)
+        fprintf(out, "%s\t%s\t%08x\t%c\n", name, path, line, REF_KINDS[v & 3]);
+      else
+        fprintf(out, "%s\t%s\t%u\t%c\n", name, path, line, REF_KINDS[v & 3]);
+    }
+    left -= n;
+  }
+}
+
+// back to sorted lines, minus the dropped files, to be merged again
+m_bool ref_dump(const m_str name, FILE* out, TagSort* drop) {
+  Refs refs;
+  if(!refs_open(&refs, name))
+    return 0;
+  for(uint32_t i = 0; i < refs.head->nsym; i++)
+    refs_print(&refs, &refs.sym[i], out, drop, 1);
+  refs_close(&refs);
+  return 1;
+}
+
+int ref_query(const m_str name, const char* str, FILE* out) {
+  Refs refs;
+  const RefSym* sym = NULL;
+  if(!refs_open(&refs, name)) {
+    fprintf(stderr, "%s: not a gwtag references file\n", name);
+    return 2;
+  }
+  uint32_t lo = 0, hi = refs.head->nsym;
+  while(lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    const int cmp = strcmp(refs.pool + refs.sym[mid].name, str);
+    if(!cmp) {
+      sym = &refs.sym[mid];
+      break;
+    }
+    if(cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if(sym)
+    refs_print(&refs, sym, out, NULL, 0);
+  refs_close(&refs);
+  return !sym;
+}
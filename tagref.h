@@ -0,0 +1,31 @@
+#ifndef TAGREF_H
+#define TAGREF_H
+#include <stdint.h>
+
+#define REF_MAGIC "GWTR"
+#define REF_VERSION 1
+
+#define REF_KINDS "ucm"
+enum { ref_use, ref_call, ref_member };
+
+typedef struct {
+  char     magic[4];
+  uint32_t version;
+  uint32_t nsym, nfile;
+  uint32_t sym, file, pool, data;
+  uint32_t size;
+} RefHeader;
+
+// the references to one symbol, as varints:
+// for each file, the file id delta, the count,
+// then for each reference (line delta << 2 | kind)
+typedef struct {
+  uint32_t name;
+  uint32_t data;
+  uint32_t n;
+} RefSym;
+
+m_bool ref_build(FILE*, const m_str);
+m_bool ref_dump(const m_str, FILE*, TagSort*);
+int ref_query(const m_str, const char*, FILE*);
+#endif
@@ -0,0 +1,97 @@
+#include <ctype.h>
+#include <string.h>
+#include "tagskim.h"
+
+// skip a string, char literal or comment starting at i, if any
+static size_t skim_skip(const char* src, const size_t len, size_t i) {
+  if(src[i] == '"' || src[i] == '\'') {
+    const char quote = src[i++];
+    while(i < len && src[i] != quote && src[i] != '\n')
+      i += src[i] == '\\' ? 2 : 1;
+    return i < len ? i + 1 : len;
+  }
+  if(src[i] == '/' && i + 1 < len && src[i + 1] == '/') {
+    const char* end = memchr(src + i, '\n', len - i);
+    return end ? (size_t)(end - src) : len;
+  }
+  if(src[i] == '/' && i + 1 < len && src[i + 1] == '*') {
+    for(i += 2; i + 1 < len; i++)
+      if(src[i] == '*' && src[i + 1] == '/')
+        return i + 2;
+    return len;
+  }
+  return i;
+}
+
+static int skim_word(const char* src, const size_t len, const size_t i,
+    const char* word) {
+  const size_t n = strlen(word);
+  return i + n <= len && !memcmp(src + i, word, n) &&
+    (i + n == len || !(isalnum((unsigned char)src[i + n]) || src[i + n] == '_'));
+}
+
+static int is_ident(const char c) {
+  return isalnum((unsigned char)c) || c == '_';
+}
+
+// the body ends at its matching brace: blank what is in between
+static size_t skim_body(char* src, const size_t len, size_t i, size_t* blank) {
+  unsigned depth = 1;
+  const size_t start = ++i;
+  while(i < len) {
+    const size_t next = skim_skip(src, len, i);
+    if(next != i) {
+      i = next;
+      continue;
+    }
+    if(src[i] == '{')
+      depth++;
+    else if(src[i] == '}' && !--depth)
+      break;
+    i++;
+  }
+  for(size_t j = start; j < i; j++)
+    if(src[j] != '\n') {
+      src[j] = ' ';
+      (*blank)++;
+    }
+  return i;
+}
+
+size_t skim_bodies(char* src, const size_t len) {
+  size_t blank = 0, i = 0;
+  unsigned paren = 0;
+  int head = 0;  // between `fun` and its body
+  while(i < len) {
+    const size_t next = skim_skip(src, len, i);
+    if(next != i) {
+      i = next;
+      continue;
+    }
+    if(is_ident(src[i])) {
+      if(!i || !is_ident(src[i - 1])) {
+        if(skim_word(src, len, i, "fun") || skim_word(src, len, i, "function") ||
+            skim_word(src, len, i, "operator")) {
+          head = 1;
+          paren = 0;
+        }
+      }
+      i++;
+      continue;
+    }
+    if(head) {
+      if(src[i] == '(')
+        paren++;
+      else if(src[i] == ')' && paren)
+        paren--;
+      else if(src[i] == ';' && !paren)
+        head = 0;
+      else if(src[i] == '{' && !paren) {
+        head = 0;
+        i = skim_body(src, len, i, &blank);
+      }
+    }
+    i++;
+  }
+  return blank;
+}
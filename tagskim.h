@@ -0,0 +1,8 @@
+#ifndef TAGSKIM_H
+#define TAGSKIM_H
+
+// blank the inside of every function body in place, newlines kept,
+// so that the parser builds `{}` for them and the lines do not move.
+// returns the number of bytes blanked.
+size_t skim_bodies(char*, const size_t);
+#endif